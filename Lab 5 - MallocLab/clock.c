@@ -16,14 +16,15 @@
 /******************************************************* 
  * Machine dependent functions 
  *
- * Note: the constants __i386__ and  __alpha
+ * Note: the constants __i386__, __x86_64__ and __alpha
  * are set by GCC when it calls the C preprocessor
  * You can verify this for yourself using gcc -v.
  *******************************************************/
 
-#if defined(__i386__)  
+#if defined(__i386__) || defined(__x86_64__)
 /*******************************************************
  * Pentium versions of start_counter() and get_counter()
+ * (rdtsc behaves the same in 64-bit mode)
  *******************************************************/
 
 
@@ -277,3 +278,123 @@ double get_comp_counter()
     return ctime;
 }
 
+
+
+/*******************************************************
+ * Hardware event counters. The events are opened as one
+ * perf_event_open group, so they always count over exactly
+ * the same interval. Events the kernel or the CPU does not
+ * support (e.g. in most VMs) are left out of the group.
+ *******************************************************/
+
+#if defined(__linux__)
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#define CACHE_MISS(cache) \
+    ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static struct {
+    unsigned type;
+    unsigned long long config;
+} hw_events[NUM_COUNTERS] = {
+    {PERF_TYPE_HW_CACHE, CACHE_MISS(PERF_COUNT_HW_CACHE_L1D)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {PERF_TYPE_HW_CACHE, CACHE_MISS(PERF_COUNT_HW_CACHE_DTLB)},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+};
+
+static int hw_leader = -1;           /* group leader fd, -1 if none open */
+static int hw_open = 0;              /* number of events in the group */
+static int hw_slot[NUM_COUNTERS];    /* position in a group read, or -1 */
+static int hw_fd[NUM_COUNTERS];      /* the open events, leader first */
+
+int init_hw_counters(void)
+{
+    struct perf_event_attr attr;
+    int i, fd;
+
+    if (hw_leader >= 0)
+	return hw_open;
+    for (i = 0; i < NUM_COUNTERS; i++) {
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = hw_events[i].type;
+	attr.config = hw_events[i].config;
+	attr.disabled = (hw_leader < 0);  /* members follow the leader */
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_GROUP;
+	fd = syscall(__NR_perf_event_open, &attr, 0, -1, hw_leader, 0);
+	if (fd < 0) {
+	    hw_slot[i] = -1;
+	    continue;
+	}
+	if (hw_leader < 0)
+	    hw_leader = fd;
+	hw_fd[hw_open] = fd;
+	hw_slot[i] = hw_open++;
+    }
+    return hw_open;
+}
+
+void close_hw_counters(void)
+{
+    int i;
+
+    for (i = hw_open - 1; i >= 0; i--)
+	close(hw_fd[i]);
+    hw_leader = -1;
+    hw_open = 0;
+}
+
+void start_hw_counters(void)
+{
+    if (hw_leader < 0)
+	return;
+    ioctl(hw_leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(hw_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+void get_hw_counters(double *counts)
+{
+    unsigned long long buf[1 + NUM_COUNTERS]; /* count, then values */
+    int i;
+
+    buf[0] = 0;
+    if (hw_leader >= 0) {
+	ioctl(hw_leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+	if (read(hw_leader, buf, sizeof(buf)) < 0)
+	    buf[0] = 0;
+    }
+    for (i = 0; i < NUM_COUNTERS; i++)
+	counts[i] = (hw_slot[i] >= 0 && hw_slot[i] < buf[0]) ?
+	    (double)buf[1 + hw_slot[i]] : -1;
+}
+
+#else
+
+int init_hw_counters(void)
+{
+    return 0;
+}
+
+void close_hw_counters(void)
+{
+}
+
+void start_hw_counters(void)
+{
+}
+
+void get_hw_counters(double *counts)
+{
+    int i;
+
+    for (i = 0; i < NUM_COUNTERS; i++)
+	counts[i] = -1;
+}
+#endif
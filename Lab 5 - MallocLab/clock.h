@@ -20,3 +20,20 @@ double mhz_full(int verbose, int sleeptime);
 void start_comp_counter();
 
 double get_comp_counter();
+
+/** Hardware event counters, read as one perf_event_open group */
+
+/* L1D read misses, LLC misses, branch mispredicts, dTLB read misses, page faults */
+#define NUM_COUNTERS 5
+
+/* Open the counters; return how many of them this machine supports */
+int init_hw_counters(void);
+
+/* Close the counters, e.g. in a child process, which must open its own */
+void close_hw_counters(void);
+
+/* Zero the counters and start counting */
+void start_hw_counters(void);
+
+/* Stop counting and store the counts, or -1 for a missing counter */
+void get_hw_counters(double *counts);
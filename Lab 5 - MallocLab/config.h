@@ -53,14 +53,16 @@
 #define UTIL_WEIGHT .60
 
 /* 
- * Alignment requirement in bytes (either 4 or 8) 
+ * Alignment requirement in bytes (4, 8 or 16) 
  */
-#define ALIGNMENT 8  
+#define ALIGNMENT 16  
 
 /* 
- * Maximum heap size in bytes 
+ * Maximum heap size in bytes (mmshim.so is built with a larger one)
  */
+#ifndef MAX_HEAP
 #define MAX_HEAP (20*(1<<20))  /* 20 MB */
+#endif
 
 /*****************************************************************************
  * Set exactly one of these USE_xxx constants to "1" to select a timing method
@@ -8,6 +8,7 @@
  * the time in CPU cycles for a function f.
  */
 #include <stdlib.h>
+#include <string.h>
 #include <sys/times.h>
 #include <stdio.h>
 
@@ -36,6 +37,9 @@ static int *cache_buf = NULL;
 static double *values = NULL;
 static int samplecount = 0;
 
+static double best_cyc;                   /* fewest cycles seen so far */
+static double sample_counts[NUM_COUNTERS];/* event counts of the latest run */
+
 /* for debugging only */
 #define KEEP_VALS 0
 #define KEEP_SAMPLES 0
@@ -97,6 +101,19 @@ static int has_converged()
 	((1 + epsilon)*values[0] >= values[kbest-1]);
 }
 
+/* 
+ * keep_counts - Save the event counts of a run of cyc cycles in counts
+ *     if it is the fastest run so far. Called before add_sample.
+ */
+static void keep_counts(double cyc, double *counts)
+{
+    get_hw_counters(sample_counts);
+    if (samplecount == 0 || cyc < best_cyc) {
+	best_cyc = cyc;
+	memcpy(counts, sample_counts, sizeof(sample_counts));
+    }
+}
+
 /* 
  * clear - Code to clear cache 
  */
@@ -126,7 +143,7 @@ static void clear()
 /*
  * fcyc - Use K-best scheme to estimate the running time of function f
  */
-double fcyc(test_funct f, void *argp)
+double fcyc(test_funct f, void *argp, double *counts)
 {
     double result;
     init_sampler();
@@ -135,9 +152,13 @@ double fcyc(test_funct f, void *argp)
 	    double cyc;
 	    if (clear_cache)
 		clear();
+	    if (counts)
+		start_hw_counters();
 	    start_comp_counter();
 	    f(argp);
 	    cyc = get_comp_counter();
+	    if (counts)
+		keep_counts(cyc, counts);
 	    add_sample(cyc);
 	} while (!has_converged() && samplecount < maxsamples);
     } else {
@@ -145,9 +166,13 @@ double fcyc(test_funct f, void *argp)
 	    double cyc;
 	    if (clear_cache)
 		clear();
+	    if (counts)
+		start_hw_counters();
 	    start_counter();
 	    f(argp);
 	    cyc = get_counter();
+	    if (counts)
+		keep_counts(cyc, counts);
 	    add_sample(cyc);
 	} while (!has_converged() && samplecount < maxsamples);
     }
@@ -10,8 +10,12 @@
 /* The test function takes a generic pointer as input */
 typedef void (*test_funct)(void *);
 
-/* Compute number of cycles used by test function f */
-double fcyc(test_funct f, void* argp);
+/* 
+ * Compute number of cycles used by test function f. If counts is not
+ * NULL, also store there the NUM_COUNTERS hardware event counts (see
+ * clock.h) of the run that took the fewest cycles.
+ */
+double fcyc(test_funct f, void* argp, double *counts);
 
 /*********************************************************
  * Set the various parameters used by measurement routines 
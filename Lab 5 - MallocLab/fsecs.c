@@ -8,6 +8,8 @@
 #include "ftimer.h"
 #include "config.h"
 
+#define FTIMER_RUNS 10  /* runs averaged by the interval timers */
+
 static double Mhz;  /* estimated CPU clock frequency */
 
 extern int verbose; /* -v option in mdriver.c */
@@ -40,17 +42,33 @@ void init_fsecs(void)
 }
 
 /*
- * fsecs - Return the running time of a function f (in seconds)
+ * fsecs - Return the running time of a function f (in seconds). If
+ *     counts is not NULL, also store there the hardware event counts
+ *     (see clock.h) of one run of f, -1 for any counter not available.
  */
-double fsecs(fsecs_test_funct f, void *argp) 
+double fsecs(fsecs_test_funct f, void *argp, double *counts) 
 {
 #if USE_FCYC
-    double cycles = fcyc(f, argp);
+    double cycles = fcyc(f, argp, counts);
     return cycles/(Mhz*1e6);
-#elif USE_ITIMER
-    return ftimer_itimer(f, argp, 10);
+#else
+    double secs;
+    int i;
+
+    if (counts)
+	start_hw_counters();
+#if USE_ITIMER
+    secs = ftimer_itimer(f, argp, FTIMER_RUNS);
 #elif USE_GETTOD
-    return ftimer_gettod(f, argp, 10);
+    secs = ftimer_gettod(f, argp, FTIMER_RUNS);
+#endif
+    if (counts) {
+	get_hw_counters(counts);
+	for (i = 0; i < NUM_COUNTERS; i++)
+	    if (counts[i] > 0)
+		counts[i] /= FTIMER_RUNS;
+    }
+    return secs;
 #endif 
 }
 
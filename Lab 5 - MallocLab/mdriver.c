@@ -14,12 +14,22 @@
 #include <string.h>
 #include <assert.h>
 #include <float.h>
+#include <limits.h>
 #include <time.h>
+#include <pthread.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <sys/time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 
 #include "mm.h"
 #include "memlib.h"
 #include "fsecs.h"
+#include "clock.h"
 #include "config.h"
+#include "tracefmt.h"
 
 /**********************
  * Constants and macros
@@ -29,37 +39,77 @@
 #define MAXLINE     1024 /* max string size */
 #define HDRLINES       4 /* number of header lines in a trace file */
 #define LINENUM(i) (i+5) /* cnvt trace request nums to linenums (origin 1) */
+#define PAR_REPS      10 /* times each thread replays its trace in -P mode */
+#define FRAG_EVERY  1000 /* default requests between -F samples */
+#define MAXLIBS       32 /* most allocator variants given with -m */
+#define CMP_WIDTH     17 /* least width of a -m util/Kops column pair */
+#define NUM_REQTYPES   7 /* ALLOC .. CALLOC in tracefmt.h */
+#define RANGE_LEVELS  24 /* skip list levels, plenty for 2^24 live blocks */
+
+/* Latency histograms: HIST_SUB log buckets per power of two (-H mode) */
+#define HIST_SUB_BITS  4
+#define HIST_SUB       (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS   (64 * HIST_SUB)
 
 /* Returns true if p is ALIGNMENT-byte aligned */
-#define IS_ALIGNED(p)  ((((unsigned int)(p)) % ALIGNMENT) == 0)
+#define IS_ALIGNED(p)  ((((size_t)(p)) % ALIGNMENT) == 0)
 
 /****************************** 
  * The key compound data types 
  *****************************/
 
-/* Records the extent of each block's payload */
+/* Records the extent of each block's payload, as a skip list node */
 typedef struct range_t {
     char *lo;              /* low payload address */
     char *hi;              /* high payload address */
-    struct range_t *next;  /* next list element */
+    int levels;            /* number of forward links */
+    struct range_t *next[];/* next element at each level, lo ascending */
 } range_t;
 
-/* Characterizes a single trace operation (allocator request) */
+/* 
+ * The entry points of a malloc package and of the memlib it allocates
+ * from. The driver makes every call through one of these, so a variant
+ * loaded from a shared object, with its own memlib, can be run exactly
+ * like the package linked into the driver.
+ */
 typedef struct {
-    enum {ALLOC, FREE, REALLOC} type; /* type of request */
-    int index;                        /* index for free() to use later */
-    int size;                         /* byte size of alloc/realloc request */
-} traceop_t;
+    char *name;
+    int (*init)(void);
+    void *(*malloc)(size_t size);
+    void (*free)(void *ptr);
+    void *(*realloc)(void *ptr, size_t size);
+    void (*freestats)(size_t *count, size_t *largest); /* may be NULL */
+    void (*growstats)(size_t *exact, size_t *doubled, size_t *halved); /* may be NULL */
+    int (*checkheap)(int verbose);                     /* may be NULL */
+    size_t (*malloc_batch)(size_t size, size_t n, void **out); /* may be NULL */
+    void (*free_batch)(void **ptrs, size_t n);         /* may be NULL */
+    void *(*memalign)(size_t alignment, size_t size);  /* may be NULL */
+    void *(*calloc)(size_t nmemb, size_t size);        /* may be NULL */
+    void *(*malloc_hint)(size_t size, int lifetime);   /* may be NULL */
+    void (*mem_init)(void);
+    void (*mem_reset_brk)(void);
+    void *(*mem_heap_lo)(void);
+    void *(*mem_heap_hi)(void);
+    size_t (*mem_heapsize)(void);
+    size_t (*mem_heap_peak)(void);
+    size_t (*mem_rss)(void);
+    size_t (*mem_peak_span)(void);
+} allocator_t;
 
 /* Holds the information for one trace file*/
 typedef struct {
     int sugg_heapsize;   /* suggested heap size (unused) */
     int num_ids;         /* number of alloc/realloc ids */
     int num_ops;         /* number of distinct requests */
+    int num_reqs;        /* requests, counting each block of a batch */
     int weight;          /* weight for this trace (unused) */
     traceop_t *ops;      /* array of requests */
     char **blocks;       /* array of ptrs returned by malloc/realloc... */
     size_t *block_sizes; /* ... and a corresponding array of payload sizes */
+    void *map;           /* mapped binary trace file holding ops, or NULL */
+    size_t maplen;       /* length of that mapping */
+    unsigned char *hints;/* lifetime class of each op's block, or NULL */
+    int num_hinted;      /* allocations hinted short-lived */
 } trace_t;
 
 /* 
@@ -72,6 +122,25 @@ typedef struct {
     range_t *ranges;
 } speed_t;
 
+/* Holds the params of one replay thread in -P mode */
+typedef struct {
+    trace_t *trace;  /* shared, read-only request array */
+    char **blocks;   /* this thread's own block pointers */
+    int ok;          /* did every request succeed? */
+} thread_t;
+
+/* 
+ * Counts the latencies, in cycles, of one type of request. Values
+ * below 2*HIST_SUB get a bucket each; above that, each power of two is
+ * split into HIST_SUB buckets, so a bucket is within 1/HIST_SUB of
+ * any value in it.
+ */
+typedef struct {
+    unsigned long count[HIST_BUCKETS];
+    unsigned long total; /* number of requests timed */
+    unsigned long max;   /* slowest of them */
+} hist_t;
+
 /* Summarizes the important stats for some malloc function on some trace */
 typedef struct {
     /* defined for both libc malloc and student malloc package (mm.c) */
@@ -81,6 +150,10 @@ typedef struct {
 
     /* defined only for the student malloc package */
     double util;     /* space utilization for this trace (always 0 for libc) */
+    double peak_span;/* most heap pages spanned at once, in KB */
+    double end_rss;  /* heap bytes still resident after the trace, in KB */
+    double hw[NUM_COUNTERS]; /* hardware events in one run, if -C was given */
+    hist_t *lat;     /* per request type latencies, if -H was given */
 
     /* Note: secs and util are only defined if valid is true */
 } stats_t; 
@@ -90,7 +163,33 @@ typedef struct {
  *******************/
 int verbose = 0;        /* global flag for verbose output */
 static int errors = 0;  /* number of errs found when running student malloc */
-char msg[MAXLINE];      /* for whenever we need to compose an error message */
+char msg[2*MAXLINE];    /* for composing error messages, which may hold a path */
+
+/* Fragmentation timeline written by eval_mm_util (-F), and its period (-k) */
+static FILE *frag_file = NULL;
+static int frag_every = FRAG_EVERY;
+
+/* If set, count hardware events while timing (set by -C) */
+static int hw_counters = 0;
+
+/* If set, print the -m comparison one allocator per row (set by -T) */
+static int compare_rows = 0;
+
+/* Requests between mm_checkheap calls in eval_mm_valid, 0 = adaptive (-c) */
+static int check_every = -1;
+
+/* Blocks freed within this many requests are hinted short-lived (-L) */
+static int short_window = 0;
+
+/* The package linked into the driver, and the one under test */
+static allocator_t mm_builtin = {
+    "mm.c", mm_init, mm_malloc, mm_free, mm_realloc, mm_freestats, mm_growstats,
+    mm_checkheap,
+    mm_malloc_batch, mm_free_batch, mm_memalign, mm_calloc, mm_malloc_hint,
+    mem_init, mem_reset_brk, mem_heap_lo, mem_heap_hi, mem_heapsize,
+    mem_heap_peak, mem_rss, mem_peak_span
+};
+static allocator_t *mm = &mm_builtin;
 
 /* Directory where default tracefiles are found */
 static char tracedir[MAXLINE] = TRACEDIR;
@@ -110,23 +209,56 @@ static int add_range(range_t **ranges, char *lo, int size,
 		     int tracenum, int opnum);
 static void remove_range(range_t **ranges, char *lo);
 static void clear_ranges(range_t **ranges);
+static range_t *new_range(int levels);
+static void find_range(range_t *head, char *lo, range_t **update);
 
 /* These functions read, allocate, and free storage for traces */
 static trace_t *read_trace(char *tracedir, char *filename);
+static int map_trace(trace_t *trace, char *path);
+static int bad_op(traceop_t *op, int num_ids);
 static void free_trace(trace_t *trace);
+static int count_reqs(trace_t *trace);
+static void hint_lifetimes(trace_t *trace);
 
 /* Routines for evaluating the correctness and speed of libc malloc */
 static int eval_libc_valid(trace_t *trace, int tracenum);
 static void eval_libc_speed(void *ptr);
+static void eval_libc_trace(int tracenum, char *tracefile, stats_t *stats);
 
 /* Routines for evaluating correctnes, space utilization, and speed 
    of the student's malloc package in mm.c */
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges);
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges);
+static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges,
+			   stats_t *stats);
+static void frag_sample(int tracenum, int opnum, int total_size);
 static void eval_mm_speed(void *ptr);
+static void eval_mm_trace(int tracenum, char *tracefile, stats_t *stats);
+static void eval_mm_latency(trace_t *trace, hist_t *lat);
+static void eval_mm_parallel(int num_tracefiles, char **tracefiles, 
+			     int max_threads);
+static void *eval_mm_thread(void *ptr);
+static void eval_mm_compare(int num_tracefiles, char **tracefiles,
+			    char **libs, int nlibs);
+static void print_compare(stats_t *st, int n, int width);
+static void load_allocator(allocator_t *a, char *path);
+static void *load_symbol(void *handle, char *name, char *path);
+static int batch_malloc(int size, int n, char **out);
+static void batch_free(char **ptrs, int n);
+static char *aligned_malloc(int align, int size);
+static char *zeroed_malloc(int n, int size);
+static char *hinted_malloc(trace_t *trace, int opnum, int size);
+
+/* These functions spread the traces over worker processes (-j) */
+static void run_jobs(int n, char **tracefiles, stats_t *stats, int njobs,
+		     void (*job)(int tracenum, char *tracefile, stats_t *stats));
+static void *shared_calloc(size_t n, size_t size);
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats);
+static void printlatency(int n, stats_t *stats, char *csvfile);
+static void hist_add(hist_t *h, unsigned long v);
+static unsigned long hist_hi(int b);
+static unsigned long hist_value(hist_t *h, double q);
 static void usage(void);
 static void unix_error(char *msg);
 static void malloc_error(int tracenum, int opnum, char *msg);
@@ -141,15 +273,17 @@ int main(int argc, char **argv)
     char c;
     char **tracefiles = NULL;  /* null-terminated array of trace file names */
     int num_tracefiles = 0;    /* the number of traces in that array */
-    trace_t *trace = NULL;     /* stores a single trace file in memory */
-    range_t *ranges = NULL;    /* keeps track of block extents for one trace */
     stats_t *libc_stats = NULL;/* libc stats for each trace */
     stats_t *mm_stats = NULL;  /* mm (i.e. student) stats for each trace */
-    speed_t speed_params;      /* input parameters to the xx_speed routines */ 
 
     int team_check = 1;  /* If set, check team structure (reset by -a) */
     int run_libc = 0;    /* If set, run libc malloc (set by -l) */
     int autograder = 0;  /* If set, emit summary info for autograder (-g) */
+    int max_threads = -1;/* If >= 0, run the concurrent replay (set by -P) */
+    int njobs = 1;       /* Traces evaluated at once (set by -j) */
+    char *latfile = NULL;/* If set, time each request, CSV to here (-H) */
+    char *libs[MAXLIBS]; /* allocator variants to compare (set by -m) */
+    int nlibs = 0;
 
     /* temporaries used to compute the performance index */
     double secs, ops, util, avg_mm_util, avg_mm_throughput, p1, p2, perfindex;
@@ -158,7 +292,7 @@ int main(int argc, char **argv)
     /* 
      * Read and interpret the command line arguments 
      */
-    while ((c = getopt(argc, argv, "f:t:hvVgal")) != EOF) {
+    while ((c = getopt(argc, argv, "f:t:hvVgalP:H:F:k:m:Cc:j:TL:")) != EOF) {
         switch (c) {
 	case 'g': /* Generate summary info for the autograder */
 	    autograder = 1;
@@ -184,6 +318,44 @@ int main(int argc, char **argv)
         case 'l': /* Run libc malloc */
             run_libc = 1;
             break;
+        case 'j': /* Evaluate up to n traces at once (0 = #cores) */
+            if ((njobs = atoi(optarg)) <= 0)
+		njobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+            break;
+        case 'P': /* Replay traces concurrently on 1..n threads */
+            max_threads = atoi(optarg);
+            break;
+        case 'H': /* Histogram per-request latencies, CSV to file or "-" */
+            latfile = optarg;
+            break;
+        case 'F': /* Write a fragmentation timeline to a file */
+            if ((frag_file = fopen(optarg, "w")) == NULL)
+		unix_error("Could not open fragmentation timeline file");
+	    fprintf(frag_file, "trace,op,live,heap,free_blocks,largest_free\n");
+            break;
+        case 'm': /* Compare with an allocator variant in a shared object */
+            if (nlibs == MAXLIBS)
+		app_error("Too many -m allocator variants");
+            libs[nlibs++] = optarg;
+            break;
+        case 'T': /* One row per allocator in the -m comparison */
+            compare_rows = 1;
+            break;
+        case 'c': /* Check the heap every n requests (0 = adaptive) */
+            if ((check_every = atoi(optarg)) < 0)
+		check_every = 0;
+            break;
+        case 'L': /* Hint blocks freed within n requests as short-lived */
+            if ((short_window = atoi(optarg)) < 0)
+		short_window = 0;
+            break;
+        case 'C': /* Count hardware events while timing */
+            hw_counters = 1;
+            break;
+        case 'k': /* Requests between fragmentation samples */
+            if ((frag_every = atoi(optarg)) < 1)
+		frag_every = 1;
+            break;
         case 'v': /* Print per-trace performance breakdown */
             verbose = 1;
             break;
@@ -235,8 +407,14 @@ int main(int argc, char **argv)
 	printf("Using default tracefiles in %s\n", tracedir);
     }
 
+    /* The -F timeline is written in request order, one trace at a time */
+    if (frag_file != NULL)
+	njobs = 1;
+
     /* Initialize the timing package */
     init_fsecs();
+    if (hw_counters && init_hw_counters() < NUM_COUNTERS)
+	printf("Some hardware event counters are not available here\n");
 
     /*
      * Optionally run and evaluate the libc malloc package 
@@ -246,25 +424,10 @@ int main(int argc, char **argv)
 	    printf("\nTesting libc malloc\n");
 	
 	/* Allocate libc stats array, with one stats_t struct per tracefile */
-	libc_stats = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
-	if (libc_stats == NULL)
-	    unix_error("libc_stats calloc in main failed");
+	libc_stats = (stats_t *)shared_calloc(num_tracefiles, sizeof(stats_t));
 	
 	/* Evaluate the libc malloc package using the K-best scheme */
-	for (i=0; i < num_tracefiles; i++) {
-	    trace = read_trace(tracedir, tracefiles[i]);
-	    libc_stats[i].ops = trace->num_ops;
-	    if (verbose > 1)
-		printf("Checking libc malloc for correctness, ");
-	    libc_stats[i].valid = eval_libc_valid(trace, i);
-	    if (libc_stats[i].valid) {
-		speed_params.trace = trace;
-		if (verbose > 1)
-		    printf("and performance.\n");
-		libc_stats[i].secs = fsecs(eval_libc_speed, &speed_params);
-	    }
-	    free_trace(trace);
-	}
+	run_jobs(num_tracefiles, tracefiles, libc_stats, njobs, eval_libc_trace);
 
 	/* Display the libc results in a compact table */
 	if (verbose) {
@@ -280,32 +443,15 @@ int main(int argc, char **argv)
 	printf("\nTesting mm malloc\n");
 
     /* Allocate the mm stats array, with one stats_t struct per tracefile */
-    mm_stats = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
-    if (mm_stats == NULL)
-	unix_error("mm_stats calloc in main failed");
+    mm_stats = (stats_t *)shared_calloc(num_tracefiles, sizeof(stats_t));
+    for (i = 0; latfile != NULL && i < num_tracefiles; i++)
+	mm_stats[i].lat = (hist_t *)shared_calloc(NUM_REQTYPES, sizeof(hist_t));
     
     /* Initialize the simulated memory system in memlib.c */
-    mem_init(); 
+    mm->mem_init(); 
 
     /* Evaluate student's mm malloc package using the K-best scheme */
-    for (i=0; i < num_tracefiles; i++) {
-	trace = read_trace(tracedir, tracefiles[i]);
-	mm_stats[i].ops = trace->num_ops;
-	if (verbose > 1)
-	    printf("Checking mm_malloc for correctness, ");
-	mm_stats[i].valid = eval_mm_valid(trace, i, &ranges);
-	if (mm_stats[i].valid) {
-	    if (verbose > 1)
-		printf("efficiency, ");
-	    mm_stats[i].util = eval_mm_util(trace, i, &ranges);
-	    speed_params.trace = trace;
-	    speed_params.ranges = ranges;
-	    if (verbose > 1)
-		printf("and performance.\n");
-	    mm_stats[i].secs = fsecs(eval_mm_speed, &speed_params);
-	}
-	free_trace(trace);
-    }
+    run_jobs(num_tracefiles, tracefiles, mm_stats, njobs, eval_mm_trace);
 
     /* Display the mm results in a compact table */
     if (verbose) {
@@ -314,6 +460,18 @@ int main(int argc, char **argv)
 	printf("\n");
     }
 
+    /* Show the tail latencies, if we measured them */
+    if (latfile != NULL)
+	printlatency(num_tracefiles, mm_stats, latfile);
+
+    /* Optionally measure how throughput scales with concurrent threads */
+    if (max_threads >= 0)
+	eval_mm_parallel(num_tracefiles, tracefiles, max_threads);
+
+    /* Optionally compare with the allocator variants */
+    if (nlibs > 0)
+	eval_mm_compare(num_tracefiles, tracefiles, libs, nlibs);
+
     /* 
      * Accumulate the aggregate statistics for the student's mm package 
      */
@@ -365,6 +523,9 @@ int main(int argc, char **argv)
     }
 
 
+    if (frag_file != NULL)
+	fclose(frag_file);
+
     if (autograder) {
 	printf("correct:%d\n", numcorrect);
 	printf("perfidx:%.0f\n", perfindex);
@@ -378,6 +539,11 @@ int main(int argc, char **argv)
  * The following routines manipulate the range list, which keeps 
  * track of the extent of every allocated block payload. We use the 
  * range list to detect any overlapping allocated blocks.
+ *
+ * The list is a skip list sorted by lo, headed by a sentinel with
+ * RANGE_LEVELS links. Since the recorded payloads never overlap, they
+ * are sorted by hi as well, so a new payload can only overlap its two
+ * neighbors in lo order, and finding those takes O(log n) steps.
  ****************************************************************/
 
 /*
@@ -390,7 +556,9 @@ static int add_range(range_t **ranges, char *lo, int size,
 		     int tracenum, int opnum)
 {
     char *hi = lo + size - 1;
-    range_t *p;
+    range_t *p, *q;
+    range_t *update[RANGE_LEVELS];
+    int i, levels;
     char msg[MAXLINE];
 
     assert(size > 0);
@@ -404,35 +572,43 @@ static int add_range(range_t **ranges, char *lo, int size,
     }
 
     /* The payload must lie within the extent of the heap */
-    if ((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) || 
-	(hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) {
+    if ((lo < (char *)mm->mem_heap_lo()) || (lo > (char *)mm->mem_heap_hi()) || 
+	(hi < (char *)mm->mem_heap_lo()) || (hi > (char *)mm->mem_heap_hi())) {
 	sprintf(msg, "Payload (%p:%p) lies outside heap (%p:%p)",
-		lo, hi, mem_heap_lo(), mem_heap_hi());
+		lo, hi, mm->mem_heap_lo(), mm->mem_heap_hi());
 	malloc_error(tracenum, opnum, msg);
         return 0;
     }
 
     /* The payload must not overlap any other payloads */
-    for (p = *ranges;  p != NULL;  p = p->next) {
-        if ((lo >= p->lo && lo <= p-> hi) ||
-            (hi >= p->lo && hi <= p->hi)) {
-	    sprintf(msg, "Payload (%p:%p) overlaps another payload (%p:%p)\n",
-		    lo, hi, p->lo, p->hi);
-	    malloc_error(tracenum, opnum, msg);
-	    return 0;
-        }
+    if (*ranges == NULL)
+	*ranges = new_range(RANGE_LEVELS);
+    find_range(*ranges, lo, update);
+    p = update[0];              /* last payload starting below lo */
+    q = p->next[0];             /* first payload starting at or above lo */
+    if ((p != *ranges && p->hi >= lo) || (q != NULL && q->lo <= hi)) {
+	if (p == *ranges || p->hi < lo)
+	    p = q;
+	sprintf(msg, "Payload (%p:%p) overlaps another payload (%p:%p)\n",
+		lo, hi, p->lo, p->hi);
+	malloc_error(tracenum, opnum, msg);
+	return 0;
     }
 
     /* 
      * Everything looks OK, so remember the extent of this block 
      * by creating a range struct and adding it the range list.
+     * Each node is in level i with probability 4^-i.
      */
-    if ((p = (range_t *)malloc(sizeof(range_t))) == NULL)
-	unix_error("malloc error in add_range");
-    p->next = *ranges;
+    for (levels = 1; levels < RANGE_LEVELS && (random() & 3) == 0; levels++)
+	;
+    p = new_range(levels);
     p->lo = lo;
     p->hi = hi;
-    *ranges = p;
+    for (i = 0; i < levels; i++) {
+	p->next[i] = update[i]->next[i];
+	update[i]->next[i] = p;
+    }
     return 1;
 }
 
@@ -442,18 +618,18 @@ static int add_range(range_t **ranges, char *lo, int size,
 static void remove_range(range_t **ranges, char *lo)
 {
     range_t *p;
-    range_t **prevpp = ranges;
-    int size;
+    range_t *update[RANGE_LEVELS];
+    int i;
 
-    for (p = *ranges;  p != NULL; p = p->next) {
-        if (p->lo == lo) {
-	    *prevpp = p->next;
-            size = p->hi - p->lo + 1;
-            free(p);
-            break;
-        }
-        prevpp = &(p->next);
-    }
+    if (*ranges == NULL)
+	return;
+    find_range(*ranges, lo, update);
+    p = update[0]->next[0];
+    if (p == NULL || p->lo != lo)
+	return;
+    for (i = 0; i < p->levels; i++)
+	update[i]->next[i] = p->next[i];
+    free(p);
 }
 
 /*
@@ -465,12 +641,46 @@ static void clear_ranges(range_t **ranges)
     range_t *pnext;
 
     for (p = *ranges;  p != NULL;  p = pnext) {
-        pnext = p->next;
+        pnext = p->next[0];
         free(p);
     }
     *ranges = NULL;
 }
 
+/*
+ * new_range - allocate a range record with the given number of links
+ */
+static range_t *new_range(int levels)
+{
+    range_t *p;
+    int i;
+
+    p = (range_t *)malloc(sizeof(range_t) + levels * sizeof(range_t *));
+    if (p == NULL)
+	unix_error("malloc error in new_range");
+    p->lo = p->hi = NULL;
+    p->levels = levels;
+    for (i = 0; i < levels; i++)
+	p->next[i] = NULL;
+    return p;
+}
+
+/*
+ * find_range - fill update[i] with the last record in level i of the
+ *     list at head whose payload starts below lo (head if none)
+ */
+static void find_range(range_t *head, char *lo, range_t **update)
+{
+    range_t *p = head;
+    int i;
+
+    for (i = RANGE_LEVELS-1; i >= 0; i--) {
+	while (p->next[i] != NULL && p->next[i]->lo < lo)
+	    p = p->next[i];
+	update[i] = p;
+    }
+}
+
 
 /**********************************************
  * The following routines manipulate tracefiles
@@ -485,7 +695,7 @@ static trace_t *read_trace(char *tracedir, char *filename)
     trace_t *trace;
     char type[MAXLINE];
     char path[MAXLINE];
-    unsigned index, size;
+    unsigned index, size, count;
     unsigned max_index = 0;
     unsigned op_index;
 
@@ -496,11 +706,25 @@ static trace_t *read_trace(char *tracedir, char *filename)
     if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
 	unix_error("malloc 1 failed in read_trance");
 	
-    /* Read the trace file header */
     strcpy(path, tracedir);
     strcat(path, filename);
+
+    /* A binary trace needs no parsing: replay its records in place */
+    if (map_trace(trace, path)) {
+	if ((trace->blocks = 
+	     (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
+	    unix_error("malloc 3 failed in read_trace");
+	if ((trace->block_sizes = 
+	     (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
+	    unix_error("malloc 4 failed in read_trace");
+	trace->num_reqs = count_reqs(trace);
+	hint_lifetimes(trace);
+	return trace;
+    }
+
+    /* Read the trace file header */
     if ((tracefile = fopen(path, "r")) == NULL) {
-	sprintf(msg, "Could not open %s in read_trace", path);
+	snprintf(msg, sizeof msg, "Could not open %s in read_trace", path);
 	unix_error(msg);
     }
     fscanf(tracefile, "%d", &(trace->sugg_heapsize)); /* not used */
@@ -547,6 +771,37 @@ static trace_t *read_trace(char *tracedir, char *filename)
 	    trace->ops[op_index].type = FREE;
 	    trace->ops[op_index].index = index;
 	    break;
+	case 'A':
+	    fscanf(tracefile, "%u %u %u", &index, &count, &size);
+	    trace->ops[op_index].type = ALLOC_BATCH;
+	    trace->ops[op_index].index = index;
+	    trace->ops[op_index].count = count;
+	    trace->ops[op_index].size = size;
+	    index += count - 1;
+	    max_index = (index > max_index) ? index : max_index;
+	    break;
+	case 'F':
+	    fscanf(tracefile, "%u %u", &index, &count);
+	    trace->ops[op_index].type = FREE_BATCH;
+	    trace->ops[op_index].index = index;
+	    trace->ops[op_index].count = count;
+	    break;
+	case 'm':
+	    fscanf(tracefile, "%u %u %u", &index, &count, &size);
+	    trace->ops[op_index].type = MEMALIGN;
+	    trace->ops[op_index].index = index;
+	    trace->ops[op_index].count = count;
+	    trace->ops[op_index].size = size;
+	    max_index = (index > max_index) ? index : max_index;
+	    break;
+	case 'c':
+	    fscanf(tracefile, "%u %u %u", &index, &count, &size);
+	    trace->ops[op_index].type = CALLOC;
+	    trace->ops[op_index].index = index;
+	    trace->ops[op_index].count = count;
+	    trace->ops[op_index].size = size;
+	    max_index = (index > max_index) ? index : max_index;
+	    break;
 	default:
 	    printf("Bogus type character (%c) in tracefile %s\n", 
 		   type[0], path);
@@ -558,19 +813,178 @@ static trace_t *read_trace(char *tracedir, char *filename)
     fclose(tracefile);
     assert(max_index == trace->num_ids - 1);
     assert(trace->num_ops == op_index);
+    trace->num_reqs = count_reqs(trace);
+    hint_lifetimes(trace);
     
     return trace;
 }
 
+/*
+ * count_reqs - Count the requests in a trace, a batch of n blocks
+ *     counting as n of them, so that throughputs compare across traces
+ */
+static int count_reqs(trace_t *trace)
+{
+    int i, n = 0;
+
+    for (i = 0; i < trace->num_ops; i++)
+	if (trace->ops[i].type == ALLOC_BATCH || trace->ops[i].type == FREE_BATCH)
+	    n += trace->ops[i].count;
+	else
+	    n++;
+    return n;
+}
+
+/*
+ * hint_lifetimes - With -L, look ahead in the trace for the blocks
+ *     that mm_malloc allocates and that are freed again within
+ *     short_window requests, and mark them short-lived in
+ *     trace->hints. This is the lifetime class an application would
+ *     pass to mm_malloc_hint if it knew, or learned from a profile.
+ */
+static void hint_lifetimes(trace_t *trace)
+{
+    int i, j, *born;
+    traceop_t *op;
+
+    trace->hints = NULL;
+    trace->num_hinted = 0;
+    if (short_window == 0)
+	return;
+    if ((trace->hints = (unsigned char *)calloc(trace->num_ops, 1)) == NULL ||
+	(born = (int *)malloc(trace->num_ids * sizeof(int))) == NULL)
+	unix_error("malloc failed in hint_lifetimes");
+
+    /* born[id] is the request that mm_malloc'd block id, or -1 */
+    for (i = 0; i < trace->num_ids; i++)
+	born[i] = -1;
+    for (i = 0; i < trace->num_ops; i++) {
+	op = &trace->ops[i];
+	switch (op->type) {
+	case ALLOC:
+	    born[op->index] = i;
+	    break;
+	case FREE:
+	case FREE_BATCH:
+	    for (j = op->index; j < op->index + (op->type == FREE ? 1 : op->count); j++)
+		if (born[j] >= 0 && i - born[j] <= short_window) {
+		    trace->hints[born[j]] = 1;
+		    trace->num_hinted++;
+		}
+	    break;
+	case ALLOC_BATCH:
+	    for (j = op->index; j < op->index + op->count; j++)
+		born[j] = -1;
+	    break;
+	default:              /* resized, aligned and zeroed ones take none */
+	    born[op->index] = -1;
+	    break;
+	}
+    }
+    free(born);
+}
+
+/*
+ * map_trace - If path is a binary trace (see tracefmt.h), map it and
+ *     fill in trace's counts and ops from it. Returns 0 if path is
+ *     not a binary trace. The records are replayed as they are, so
+ *     every one is checked first, like the lines of a text trace.
+ */
+static int map_trace(trace_t *trace, char *path)
+{
+    int fd;
+    struct stat st;
+    tracehdr_t *hdr;
+    traceop_t *ops;
+    int i;
+
+    trace->map = NULL;
+    if ((fd = open(path, O_RDONLY)) < 0) {
+	snprintf(msg, sizeof msg, "Could not open %s in read_trace", path);
+	unix_error(msg);
+    }
+    if (fstat(fd, &st) < 0)
+	unix_error("fstat failed in map_trace");
+    if (st.st_size < sizeof(tracehdr_t)) {
+	close(fd);
+	return 0;
+    }
+    hdr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (hdr == MAP_FAILED)
+	unix_error("mmap failed in map_trace");
+    if (memcmp(hdr->magic, TRACE_MAGIC, sizeof(hdr->magic)) != 0) {
+	munmap(hdr, st.st_size);
+	return 0;
+    }
+
+    if (hdr->version != TRACE_VERSION || hdr->num_ops < 0 || hdr->num_ids < 0 ||
+	(size_t)hdr->num_ops != (st.st_size - sizeof(tracehdr_t)) / sizeof(traceop_t) ||
+	(st.st_size - sizeof(tracehdr_t)) % sizeof(traceop_t) != 0) {
+	snprintf(msg, sizeof msg, "Binary trace %s is truncated or of another version", path);
+	app_error(msg);
+    }
+    ops = (traceop_t *)(hdr + 1);
+    for (i = 0; i < hdr->num_ops; i++)
+	if (bad_op(&ops[i], hdr->num_ids)) {
+	    snprintf(msg, sizeof msg, "Binary trace %s has a bad record %d", path, i);
+	    app_error(msg);
+	}
+    trace->sugg_heapsize = hdr->sugg_heapsize;
+    trace->num_ids = hdr->num_ids;
+    trace->num_ops = hdr->num_ops;
+    trace->weight = hdr->weight;
+    trace->ops = ops;
+    trace->map = hdr;
+    trace->maplen = st.st_size;
+    return 1;
+}
+
+/*
+ * bad_op - Return nonzero unless op is a request of a known type on
+ *     ids within 0..num_ids-1, with no negative size or count, and
+ *     for a calloc an array whose bytes fit in an int
+ */
+static int bad_op(traceop_t *op, int num_ids)
+{
+    int n = 1;                  /* ids the request names */
+
+    if (op->index < 0 || op->size < 0 || op->count < 0)
+	return 1;
+    switch (op->type) {
+    case ALLOC_BATCH:
+    case FREE_BATCH:
+	n = op->count;
+	break;
+    case CALLOC:
+	if (op->size > 0 && op->count > INT_MAX / op->size)
+	    return 1;
+	break;
+    case ALLOC:
+    case FREE:
+    case REALLOC:
+    case MEMALIGN:
+	break;
+    default:
+	return 1;
+    }
+    return op->index > num_ids - n;
+}
+
 /*
  * free_trace - Free the trace record and the three arrays it points
- *              to, all of which were allocated in read_trace().
+ *              to, all of which were allocated in read_trace(). The
+ *              ops of a binary trace are unmapped instead.
  */
 void free_trace(trace_t *trace)
 {
-    free(trace->ops);         /* free the three arrays... */
+    if (trace->map != NULL)   /* free the three arrays... */
+	munmap(trace->map, trace->maplen);
+    else
+	free(trace->ops);
     free(trace->blocks);      
     free(trace->block_sizes);
+    free(trace->hints);
     free(trace);              /* and the trace record itself... */
 }
 
@@ -579,25 +993,92 @@ void free_trace(trace_t *trace)
  * and throughput of the libc and mm malloc packages.
  **********************************************************************/
 
+/*
+ * eval_mm_trace - Evaluate the mm package on trace tracenum, read from
+ *    tracefile: its correctness and, if it is correct, its utilization,
+ *    its throughput, and with -H its per-request latencies
+ */
+static void eval_mm_trace(int tracenum, char *tracefile, stats_t *stats)
+{
+    static range_t *ranges = NULL; /* keeps track of block extents */
+    trace_t *trace;
+    speed_t speed_params;
+
+    trace = read_trace(tracedir, tracefile);
+    stats->ops = trace->num_reqs;
+    if (verbose > 1)
+	printf("Checking mm_malloc for correctness, ");
+    stats->valid = eval_mm_valid(trace, tracenum, &ranges);
+    if (stats->valid) {
+	if (verbose > 1)
+	    printf("efficiency, ");
+	stats->util = eval_mm_util(trace, tracenum, &ranges, stats);
+	speed_params.trace = trace;
+	speed_params.ranges = ranges;
+	if (verbose > 1)
+	    printf("and performance.\n");
+	if (verbose > 1 && mm->growstats != NULL) {
+	    size_t exact, doubled, halved;
+
+	    mm->growstats(&exact, &doubled, &halved);
+	    printf("Heap growths: %lu by the shortfall, %lu doubled, %lu halved\n",
+		   (unsigned long)exact, (unsigned long)doubled, (unsigned long)halved);
+	}
+	if (verbose > 1 && trace->hints != NULL)
+	    printf("Lifetime hints: %d blocks short-lived\n", trace->num_hinted);
+	stats->secs = fsecs(eval_mm_speed, &speed_params,
+			    hw_counters ? stats->hw : NULL);
+	if (stats->lat != NULL)
+	    eval_mm_latency(trace, stats->lat);
+    }
+    free_trace(trace);
+}
+
+/*
+ * eval_libc_trace - Evaluate libc malloc on trace tracenum, read from
+ *    tracefile: its correctness and, if it is correct, its throughput
+ */
+static void eval_libc_trace(int tracenum, char *tracefile, stats_t *stats)
+{
+    trace_t *trace;
+    speed_t speed_params;
+
+    trace = read_trace(tracedir, tracefile);
+    stats->ops = trace->num_reqs;
+    if (verbose > 1)
+	printf("Checking libc malloc for correctness, ");
+    stats->valid = eval_libc_valid(trace, tracenum);
+    if (stats->valid) {
+	speed_params.trace = trace;
+	if (verbose > 1)
+	    printf("and performance.\n");
+	stats->secs = fsecs(eval_libc_speed, &speed_params,
+			    hw_counters ? stats->hw : NULL);
+    }
+    free_trace(trace);
+}
+
 /*
  * eval_mm_valid - Check the mm malloc package for correctness
  */
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) 
 {
-    int i, j;
+    int i, j, n;
     int index;
     int size;
     int oldsize;
     char *newp;
     char *oldp;
     char *p;
+    int live = 0;      /* blocks currently allocated */
+    int since = 0;     /* requests since the last heap check */
     
     /* Reset the heap and free any records in the range list */
-    mem_reset_brk();
+    mm->mem_reset_brk();
     clear_ranges(ranges);
 
     /* Call the mm package's init function */
-    if (mm_init() < 0) {
+    if (mm->init() < 0) {
 	malloc_error(tracenum, 0, "mm_init failed.");
 	return 0;
     }
@@ -612,7 +1093,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
         case ALLOC: /* mm_malloc */
 
 	    /* Call the student's malloc */
-	    if ((p = mm_malloc(size)) == NULL) {
+	    if ((p = hinted_malloc(trace, i, size)) == NULL) {
 		malloc_error(tracenum, i, "mm_malloc failed.");
 		return 0;
 	    }
@@ -635,13 +1116,14 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    /* Remember region */
 	    trace->blocks[index] = p;
 	    trace->block_sizes[index] = size;
+	    live++;
 	    break;
 
         case REALLOC: /* mm_realloc */
 	    
 	    /* Call the student's realloc */
 	    oldp = trace->blocks[index];
-	    if ((newp = mm_realloc(oldp, size)) == NULL) {
+	    if ((newp = mm->realloc(oldp, size)) == NULL) {
 		malloc_error(tracenum, i, "mm_realloc failed.");
 		return 0;
 	    }
@@ -661,7 +1143,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    oldsize = trace->block_sizes[index];
 	    if (size < oldsize) oldsize = size;
 	    for (j = 0; j < oldsize; j++) {
-	      if (newp[j] != (index & 0xFF)) {
+	      if ((unsigned char)newp[j] != (index & 0xFF)) {
 		malloc_error(tracenum, i, "mm_realloc did not preserve the "
 			     "data from old block");
 		return 0;
@@ -679,13 +1161,94 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    /* Remove region from list and call student's free function */
 	    p = trace->blocks[index];
 	    remove_range(ranges, p);
-	    mm_free(p);
+	    mm->free(p);
+	    live--;
+	    break;
+
+        case ALLOC_BATCH: /* mm_malloc_batch */
+	    n = trace->ops[i].count;
+	    if (batch_malloc(size, n, trace->blocks + index) != n) {
+		malloc_error(tracenum, i, "mm_malloc_batch failed.");
+		return 0;
+	    }
+
+	    /* Check and fill each block as if it came from mm_malloc */
+	    for (j = index; j < index + n; j++) {
+		if (add_range(ranges, trace->blocks[j], size, tracenum, i) == 0)
+		    return 0;
+		memset(trace->blocks[j], j & 0xFF, size);
+		trace->block_sizes[j] = size;
+	    }
+	    live += n;
+	    break;
+
+        case FREE_BATCH: /* mm_free_batch */
+	    n = trace->ops[i].count;
+	    for (j = index; j < index + n; j++)
+		remove_range(ranges, trace->blocks[j]);
+	    batch_free(trace->blocks + index, n);
+	    live -= n;
+	    break;
+
+        case MEMALIGN: /* mm_memalign */
+	    if ((p = aligned_malloc(trace->ops[i].count, size)) == NULL) {
+		malloc_error(tracenum, i, "mm_memalign failed.");
+		return 0;
+	    }
+	    if ((size_t)p % trace->ops[i].count) {
+		sprintf(msg, "mm_memalign payload %p is not %d-byte aligned",
+			p, trace->ops[i].count);
+		malloc_error(tracenum, i, msg);
+		return 0;
+	    }
+	    if (add_range(ranges, p, size, tracenum, i) == 0)
+		return 0;
+	    memset(p, index & 0xFF, size);
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = size;
+	    live++;
+	    break;
+
+        case CALLOC: /* mm_calloc */
+	    n = trace->ops[i].count;
+	    if ((p = zeroed_malloc(n, size)) == NULL) {
+		malloc_error(tracenum, i, "mm_calloc failed.");
+		return 0;
+	    }
+	    if (add_range(ranges, p, n * size, tracenum, i) == 0)
+		return 0;
+	    for (j = 0; j < n * size; j++) {
+		if (p[j] != 0) {
+		    malloc_error(tracenum, i, "mm_calloc did not zero the block");
+		    return 0;
+		}
+	    }
+	    memset(p, index & 0xFF, n * size);
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = n * size;
+	    live++;
 	    break;
 
 	default:
 	    app_error("Nonexistent request type in eval_mm_valid");
         }
 
+	/* 
+	 * With -c, run the package's heap checker. In adaptive mode it
+	 * runs once the requests since the last check reach the number
+	 * of live blocks, so a checker that is linear in the heap adds
+	 * only a constant amortized cost per request.
+	 */
+	if (check_every >= 0 && mm->checkheap != NULL &&
+	    (++since >= (check_every ? check_every : live) ||
+	     i == trace->num_ops - 1)) {
+	    since = 0;
+	    if ((j = mm->checkheap(0)) > 0) {
+		sprintf(msg, "mm_checkheap found %d errors", j);
+		malloc_error(tracenum, i, msg);
+		return 0;
+	    }
+	}
     }
 
     /* As far as we know, this is a valid malloc package */
@@ -697,15 +1260,16 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
  *   The idea is to remember the high water mark "hwm" of the heap for 
  *   an optimal allocator, i.e., no gaps and no internal fragmentation.
  *   Utilization is the ratio hwm/heapsize, where heapsize is the 
- *   size of the heap in bytes after running the student's malloc 
- *   package on the trace. Note that our implementation of mem_sbrk() 
- *   doesn't allow the students to decrement the brk pointer, so brk
- *   is always the high water mark of the heap. 
- *   
+ *   largest size the heap reached while running the student's malloc 
+ *   package on the trace. Since mem_sbrk() lets the brk shrink, the
+ *   final brk may be lower than that. The peak and final resident heap
+ *   sizes are recorded in stats. With -F, the heap is also sampled
+ *   every frag_every requests and after the last one.
  */
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
+static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges,
+			   stats_t *stats)
 {   
-    int i;
+    int i, j, n;
     int index;
     int size, newsize, oldsize;
     int max_total_size = 0;
@@ -714,18 +1278,20 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
     char *newp, *oldp;
 
     /* initialize the heap and the mm malloc package */
-    mem_reset_brk();
-    if (mm_init() < 0)
+    mm->mem_reset_brk();
+    if (mm->init() < 0)
 	app_error("mm_init failed in eval_mm_util");
 
     for (i = 0;  i < trace->num_ops;  i++) {
+	if (frag_file != NULL && i % frag_every == 0)
+	    frag_sample(tracenum, i, total_size);
         switch (trace->ops[i].type) {
 
         case ALLOC: /* mm_alloc */
 	    index = trace->ops[i].index;
 	    size = trace->ops[i].size;
 
-	    if ((p = mm_malloc(size)) == NULL) 
+	    if ((p = hinted_malloc(trace, i, size)) == NULL) 
 		app_error("mm_malloc failed in eval_mm_util");
 	    
 	    /* Remember region and size */
@@ -747,7 +1313,7 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    oldsize = trace->block_sizes[index];
 
 	    oldp = trace->blocks[index];
-	    if ((newp = mm_realloc(oldp,newsize)) == NULL)
+	    if ((newp = mm->realloc(oldp,newsize)) == NULL)
 		app_error("mm_realloc failed in eval_mm_util");
 
 	    /* Remember region and size */
@@ -768,7 +1334,7 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    size = trace->block_sizes[index];
 	    p = trace->blocks[index];
 	    
-	    mm_free(p);
+	    mm->free(p);
 	    
 	    /* Keep track of current total size
 	     * of all allocated blocks */
@@ -776,13 +1342,78 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    
 	    break;
 
+        case ALLOC_BATCH: /* mm_malloc_batch */
+	    index = trace->ops[i].index;
+	    size = trace->ops[i].size;
+	    n = trace->ops[i].count;
+	    if (batch_malloc(size, n, trace->blocks + index) != n)
+		app_error("mm_malloc_batch failed in eval_mm_util");
+	    for (j = index; j < index + n; j++)
+		trace->block_sizes[j] = size;
+	    total_size += size * n;
+	    max_total_size = (total_size > max_total_size) ?
+		total_size : max_total_size;
+	    break;
+
+        case FREE_BATCH: /* mm_free_batch */
+	    index = trace->ops[i].index;
+	    n = trace->ops[i].count;
+	    batch_free(trace->blocks + index, n);
+	    for (j = index; j < index + n; j++)
+		total_size -= trace->block_sizes[j];
+	    break;
+
+        case MEMALIGN: /* mm_memalign */
+	    index = trace->ops[i].index;
+	    size = trace->ops[i].size;
+	    if ((p = aligned_malloc(trace->ops[i].count, size)) == NULL)
+		app_error("mm_memalign failed in eval_mm_util");
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = size;
+	    total_size += size;
+	    max_total_size = (total_size > max_total_size) ?
+		total_size : max_total_size;
+	    break;
+
+        case CALLOC: /* mm_calloc */
+	    index = trace->ops[i].index;
+	    size = trace->ops[i].count * trace->ops[i].size;
+	    if ((p = zeroed_malloc(trace->ops[i].count, trace->ops[i].size)) == NULL)
+		app_error("mm_calloc failed in eval_mm_util");
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = size;
+	    total_size += size;
+	    max_total_size = (total_size > max_total_size) ?
+		total_size : max_total_size;
+	    break;
+
 	default:
 	    app_error("Nonexistent request type in eval_mm_util");
 
         }
     }
 
-    return ((double)max_total_size / (double)mem_heapsize());
+    if (frag_file != NULL)
+	frag_sample(tracenum, trace->num_ops, total_size);
+    stats->peak_span = mm->mem_peak_span() / 1e3;
+    stats->end_rss = mm->mem_rss() / 1e3;
+    return ((double)max_total_size / (double)mm->mem_heap_peak());
+}
+
+/*
+ * frag_sample - Append the state of the heap before request opnum of
+ *     trace tracenum to the fragmentation timeline: live payload bytes,
+ *     heap size, number of free blocks and the largest of them
+ */
+static void frag_sample(int tracenum, int opnum, int total_size)
+{
+    size_t count = 0, largest = 0;
+
+    if (mm->freestats != NULL)
+	mm->freestats(&count, &largest);
+    fprintf(frag_file, "%d,%d,%d,%lu,%lu,%lu\n", tracenum, opnum, total_size,
+	    (unsigned long)mm->mem_heapsize(), (unsigned long)count,
+	    (unsigned long)largest);
 }
 
 
@@ -797,8 +1428,8 @@ static void eval_mm_speed(void *ptr)
     trace_t *trace = ((speed_t *)ptr)->trace;
 
     /* Reset the heap and initialize the mm package */
-    mem_reset_brk();
-    if (mm_init() < 0) 
+    mm->mem_reset_brk();
+    if (mm->init() < 0) 
 	app_error("mm_init failed in eval_mm_speed");
 
     /* Interpret each trace request */
@@ -808,7 +1439,7 @@ static void eval_mm_speed(void *ptr)
         case ALLOC: /* mm_malloc */
             index = trace->ops[i].index;
             size = trace->ops[i].size;
-            if ((p = mm_malloc(size)) == NULL)
+            if ((p = hinted_malloc(trace, i, size)) == NULL)
 		app_error("mm_malloc error in eval_mm_speed");
             trace->blocks[index] = p;
             break;
@@ -817,7 +1448,7 @@ static void eval_mm_speed(void *ptr)
 	    index = trace->ops[i].index;
             newsize = trace->ops[i].size;
 	    oldp = trace->blocks[index];
-            if ((newp = mm_realloc(oldp,newsize)) == NULL)
+            if ((newp = mm->realloc(oldp,newsize)) == NULL)
 		app_error("mm_realloc error in eval_mm_speed");
             trace->blocks[index] = newp;
             break;
@@ -825,7 +1456,33 @@ static void eval_mm_speed(void *ptr)
         case FREE: /* mm_free */
             index = trace->ops[i].index;
             block = trace->blocks[index];
-            mm_free(block);
+            mm->free(block);
+            break;
+
+        case ALLOC_BATCH: /* mm_malloc_batch */
+            index = trace->ops[i].index;
+            if (batch_malloc(trace->ops[i].size, trace->ops[i].count,
+			     trace->blocks + index) != trace->ops[i].count)
+		app_error("mm_malloc_batch error in eval_mm_speed");
+            break;
+
+        case FREE_BATCH: /* mm_free_batch */
+            index = trace->ops[i].index;
+            batch_free(trace->blocks + index, trace->ops[i].count);
+            break;
+
+        case MEMALIGN: /* mm_memalign */
+            index = trace->ops[i].index;
+            if ((p = aligned_malloc(trace->ops[i].count, trace->ops[i].size)) == NULL)
+		app_error("mm_memalign error in eval_mm_speed");
+            trace->blocks[index] = p;
+            break;
+
+        case CALLOC: /* mm_calloc */
+            index = trace->ops[i].index;
+            if ((p = zeroed_malloc(trace->ops[i].count, trace->ops[i].size)) == NULL)
+		app_error("mm_calloc error in eval_mm_speed");
+            trace->blocks[index] = p;
             break;
 
 	default:
@@ -833,6 +1490,477 @@ static void eval_mm_speed(void *ptr)
         }
 }
 
+/*
+ * eval_mm_latency - Replay the trace once, timing each request with
+ *    the cycle counter and adding it to the histogram in lat for its
+ *    type. The timer's own overhead is subtracted.
+ */
+static void eval_mm_latency(trace_t *trace, hist_t *lat)
+{
+    int i, n, index;
+    char *p;
+    double cyc, overhead;
+
+    mm->mem_reset_brk();
+    if (mm->init() < 0) 
+	app_error("mm_init failed in eval_mm_latency");
+    for (i = 0, overhead = ovhd(); i < 1000; i++) {
+	cyc = ovhd();  /* the least reading is the counter's own cost */
+	overhead = cyc < overhead ? cyc : overhead;
+    }
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+	index = trace->ops[i].index;
+        switch (trace->ops[i].type) {
+
+        case ALLOC: /* mm_malloc */
+	    start_counter();
+	    p = hinted_malloc(trace, i, trace->ops[i].size);
+	    cyc = get_counter();
+            if (p == NULL)
+		app_error("mm_malloc error in eval_mm_latency");
+            trace->blocks[index] = p;
+            break;
+
+	case REALLOC: /* mm_realloc */
+	    start_counter();
+	    p = mm->realloc(trace->blocks[index], trace->ops[i].size);
+	    cyc = get_counter();
+            if (p == NULL)
+		app_error("mm_realloc error in eval_mm_latency");
+            trace->blocks[index] = p;
+            break;
+
+        case FREE: /* mm_free */
+	    start_counter();
+            mm->free(trace->blocks[index]);
+	    cyc = get_counter();
+            break;
+
+        case ALLOC_BATCH: /* mm_malloc_batch, timed as a whole */
+	    start_counter();
+	    n = batch_malloc(trace->ops[i].size, trace->ops[i].count,
+			     trace->blocks + index);
+	    cyc = get_counter();
+            if (n != trace->ops[i].count)
+		app_error("mm_malloc_batch error in eval_mm_latency");
+            break;
+
+        case FREE_BATCH: /* mm_free_batch, timed as a whole */
+	    start_counter();
+            batch_free(trace->blocks + index, trace->ops[i].count);
+	    cyc = get_counter();
+            break;
+
+        case MEMALIGN: /* mm_memalign */
+	    start_counter();
+	    p = aligned_malloc(trace->ops[i].count, trace->ops[i].size);
+	    cyc = get_counter();
+            if (p == NULL)
+		app_error("mm_memalign error in eval_mm_latency");
+            trace->blocks[index] = p;
+            break;
+
+        case CALLOC: /* mm_calloc */
+	    start_counter();
+	    p = zeroed_malloc(trace->ops[i].count, trace->ops[i].size);
+	    cyc = get_counter();
+            if (p == NULL)
+		app_error("mm_calloc error in eval_mm_latency");
+            trace->blocks[index] = p;
+            break;
+
+	default:
+	    app_error("Nonexistent request type in eval_mm_latency");
+	    return;
+        }
+	cyc -= overhead;
+	hist_add(&lat[trace->ops[i].type], cyc > 0 ? (unsigned long)cyc : 0);
+    }
+}
+
+/*
+ * eval_mm_parallel - Measure how the mm package scales across threads.
+ *    For n = 1 up to max_threads (the number of online cores if 0), a
+ *    fresh heap is shared by n threads, thread t replaying trace
+ *    t mod num_tracefiles PAR_REPS times, and the aggregate throughput
+ *    over the wall-clock time of the whole run is reported.
+ */
+static void eval_mm_parallel(int num_tracefiles, char **tracefiles, 
+			     int max_threads)
+{
+    int i, n, ok;
+    double ops, secs, base = 0;
+    trace_t **traces;
+    thread_t *args;
+    pthread_t *tids;
+    struct timeval stv, etv;
+
+    if (max_threads == 0)
+	max_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (max_threads < 1)
+	max_threads = 1;
+
+    if ((traces = (trace_t **)calloc(num_tracefiles, sizeof(trace_t *))) == NULL ||
+	(args = (thread_t *)calloc(max_threads, sizeof(thread_t))) == NULL ||
+	(tids = (pthread_t *)calloc(max_threads, sizeof(pthread_t))) == NULL)
+	unix_error("calloc failed in eval_mm_parallel");
+    for (i = 0; i < num_tracefiles; i++)
+	traces[i] = read_trace(tracedir, tracefiles[i]);
+
+    printf("\nConcurrent replay (%d reps per thread):\n", PAR_REPS);
+    printf("%7s%10s%10s%8s%9s\n", "threads", "ops", "secs", "Kops", "speedup");
+    for (n = 1; n <= max_threads; n++) {
+	mm->mem_reset_brk();
+	if (mm->init() < 0)
+	    app_error("mm_init failed in eval_mm_parallel");
+
+	ops = 0;
+	for (i = 0; i < n; i++) {
+	    args[i].trace = traces[i % num_tracefiles];
+	    args[i].ok = 1;
+	    args[i].blocks = (char **)malloc(args[i].trace->num_ids * sizeof(char *));
+	    if (args[i].blocks == NULL)
+		unix_error("malloc failed in eval_mm_parallel");
+	    ops += (double)args[i].trace->num_reqs * PAR_REPS;
+	}
+
+	gettimeofday(&stv, NULL);
+	for (i = 0; i < n; i++)
+	    if (pthread_create(&tids[i], NULL, eval_mm_thread, &args[i]) != 0)
+		unix_error("pthread_create failed in eval_mm_parallel");
+	ok = 1;
+	for (i = 0; i < n; i++) {
+	    pthread_join(tids[i], NULL);
+	    ok &= args[i].ok;
+	    free(args[i].blocks);
+	}
+	gettimeofday(&etv, NULL);
+	secs = (etv.tv_sec - stv.tv_sec) + 1E-6*(etv.tv_usec - stv.tv_usec);
+
+	if (!ok) {
+	    printf("%7d%10s%10s%8s%9s\n", n, "-", "-", "-", "-");
+	    continue;
+	}
+	if (n == 1)
+	    base = ops/secs;
+	printf("%7d%10.0f%10.6f%8.0f%8.2fx\n", 
+	       n, ops, secs, (ops/1e3)/secs, (ops/secs)/base);
+    }
+
+    for (i = 0; i < num_tracefiles; i++)
+	free_trace(traces[i]);
+    free(traces);
+    free(args);
+    free(tids);
+}
+
+/*
+ * eval_mm_compare - Evaluate the built-in mm package and the nlibs
+ *    allocator variants in libs on one in-memory copy of the traces,
+ *    and print their utilization and throughput side by side. As in
+ *    the -P replay, errors in a variant are reported but do not count
+ *    against the built-in package's performance index.
+ */
+static void eval_mm_compare(int num_tracefiles, char **tracefiles,
+			    char **libs, int nlibs)
+{
+    int i, j, n = nlibs + 1;
+    int width = CMP_WIDTH;   /* of a column pair, or with -T of the names */
+    int saved_errors = errors;
+    FILE *saved_frag = frag_file;
+    allocator_t *allocs;
+    trace_t **traces;
+    stats_t *stats, *st;
+    range_t *ranges = NULL;
+    speed_t speed_params;
+
+    if ((allocs = (allocator_t *)calloc(n, sizeof(allocator_t))) == NULL ||
+	(traces = (trace_t **)calloc(num_tracefiles, sizeof(trace_t *))) == NULL ||
+	(stats = (stats_t *)calloc(n * num_tracefiles, sizeof(stats_t))) == NULL)
+	unix_error("calloc failed in eval_mm_compare");
+    allocs[0] = mm_builtin;
+    for (j = 0; j < nlibs; j++)
+	load_allocator(&allocs[j+1], libs[j]);
+    for (i = 0; i < num_tracefiles; i++)
+	traces[i] = read_trace(tracedir, tracefiles[i]);
+
+    frag_file = NULL;
+    for (j = 0; j < n; j++) {
+	mm = &allocs[j];
+	if (j > 0)
+	    mm->mem_init();
+	if (verbose > 1)
+	    printf("\nTesting %s\n", mm->name);
+	for (i = 0; i < num_tracefiles; i++) {
+	    st = &stats[j * num_tracefiles + i];
+	    st->ops = traces[i]->num_reqs;
+	    if (!(st->valid = eval_mm_valid(traces[i], i, &ranges)))
+		continue;
+	    st->util = eval_mm_util(traces[i], i, &ranges, st);
+	    speed_params.trace = traces[i];
+	    speed_params.ranges = ranges;
+	    st->secs = fsecs(eval_mm_speed, &speed_params, NULL);
+	}
+    }
+    mm = &mm_builtin;
+    frag_file = saved_frag;
+    errors = saved_errors;
+
+    /* One util/Kops column pair per allocator, or with -T per trace,
+       wide enough to keep the longest name apart from its neighbors */
+    for (j = 0; j < n; j++)
+	if ((int)strlen(allocs[j].name) + 2 > width)
+	    width = strlen(allocs[j].name) + 2;
+    printf("\nAllocator comparison (util, Kops):\n");
+    if (compare_rows) {
+	printf("%-*s", width, "allocator");
+	for (i = 0; i < num_tracefiles; i++)
+	    printf("%*d", CMP_WIDTH, i);
+	printf("%*s\n", CMP_WIDTH, "Total");
+	for (j = 0; j < n; j++) {
+	    printf("%-*s", width, allocs[j].name);
+	    for (i = 0; i < num_tracefiles; i++)
+		print_compare(&stats[j * num_tracefiles + i], 1, CMP_WIDTH);
+	    print_compare(&stats[j * num_tracefiles], num_tracefiles, CMP_WIDTH);
+	    printf("\n");
+	}
+    }
+    else {
+	printf("%5s", "trace");
+	for (j = 0; j < n; j++)
+	    printf("%*s", width, allocs[j].name);
+	printf("\n");
+	for (i = 0; i < num_tracefiles; i++) {
+	    printf("%5d", i);
+	    for (j = 0; j < n; j++)
+		print_compare(&stats[j * num_tracefiles + i], 1, width);
+	    printf("\n");
+	}
+	printf("%5s", "Total");
+	for (j = 0; j < n; j++)
+	    print_compare(&stats[j * num_tracefiles], num_tracefiles, width);
+	printf("\n");
+    }
+
+    for (i = 0; i < num_tracefiles; i++)
+	free_trace(traces[i]);
+    free(traces);
+    free(stats);
+    free(allocs);
+}
+
+/*
+ * print_compare - Print the util and Kops of an allocator over the n
+ *     traces whose stats start at st, or dashes if any was invalid, in
+ *     a column pair width characters wide
+ */
+static void print_compare(stats_t *st, int n, int width)
+{
+    double ops = 0, secs = 0, util = 0;
+    int i;
+
+    for (i = 0; i < n; i++) {
+	if (!st[i].valid) {
+	    printf("%*s%10s", width - 10, "-", "-");
+	    return;
+	}
+	ops += st[i].ops;
+	secs += st[i].secs;
+	util += st[i].util;
+    }
+    printf("%*.0f%%%10.0f", width - 11, (util/n)*100.0, (ops/1e3)/secs);
+}
+
+/*
+ * load_allocator - Load the allocator variant in shared object path
+ *    into a. The object must define the mm_ and mem_ functions itself,
+ *    so each variant works on a heap of its own.
+ */
+static void load_allocator(allocator_t *a, char *path)
+{
+    void *h;
+
+    if ((h = dlopen(path, RTLD_NOW | RTLD_LOCAL)) == NULL)
+	app_error(dlerror());
+    a->name = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+    a->init = load_symbol(h, "mm_init", path);
+    a->malloc = load_symbol(h, "mm_malloc", path);
+    a->free = load_symbol(h, "mm_free", path);
+    a->realloc = load_symbol(h, "mm_realloc", path);
+    a->freestats = dlsym(h, "mm_freestats");
+    a->growstats = dlsym(h, "mm_growstats");
+    a->checkheap = dlsym(h, "mm_checkheap");
+    a->malloc_batch = dlsym(h, "mm_malloc_batch");
+    a->free_batch = dlsym(h, "mm_free_batch");
+    a->memalign = dlsym(h, "mm_memalign");
+    a->calloc = dlsym(h, "mm_calloc");
+    a->malloc_hint = dlsym(h, "mm_malloc_hint");
+    a->mem_init = load_symbol(h, "mem_init", path);
+    a->mem_reset_brk = load_symbol(h, "mem_reset_brk", path);
+    a->mem_heap_lo = load_symbol(h, "mem_heap_lo", path);
+    a->mem_heap_hi = load_symbol(h, "mem_heap_hi", path);
+    a->mem_heapsize = load_symbol(h, "mem_heapsize", path);
+    a->mem_heap_peak = load_symbol(h, "mem_heap_peak", path);
+    a->mem_rss = load_symbol(h, "mem_rss", path);
+    a->mem_peak_span = load_symbol(h, "mem_peak_span", path);
+}
+
+/*
+ * load_symbol - Look up a function that shared object path must define
+ */
+static void *load_symbol(void *handle, char *name, char *path)
+{
+    void *sym;
+
+    if ((sym = dlsym(handle, name)) == NULL) {
+	snprintf(msg, sizeof msg, "%s does not define %s", path, name);
+	app_error(msg);
+    }
+    return sym;
+}
+
+/*
+ * batch_malloc - Allocate n blocks of size bytes into out with the
+ *    package's mm_malloc_batch, or with one mm_malloc per block if it
+ *    has none. Returns the number of blocks allocated.
+ */
+static int batch_malloc(int size, int n, char **out)
+{
+    int i;
+
+    if (mm->malloc_batch != NULL)
+	return (int)mm->malloc_batch(size, n, (void **)out);
+    for (i = 0; i < n && (out[i] = mm->malloc(size)) != NULL; i++)
+	;
+    return i;
+}
+
+/*
+ * batch_free - Free the n blocks in ptrs, with mm_free_batch if the
+ *    package has it
+ */
+static void batch_free(char **ptrs, int n)
+{
+    int i;
+
+    if (mm->free_batch != NULL) {
+	mm->free_batch((void **)ptrs, n);
+	return;
+    }
+    for (i = 0; i < n; i++)
+	mm->free(ptrs[i]);
+}
+
+/*
+ * aligned_malloc - Allocate size bytes on an align boundary with the
+ *    package's mm_memalign. Returns NULL if it has none.
+ */
+static char *aligned_malloc(int align, int size)
+{
+    if (mm->memalign == NULL)
+	return NULL;
+    return mm->memalign(align, size);
+}
+
+/*
+ * zeroed_malloc - Allocate a zero-filled array of n elements of size
+ *    bytes with the package's mm_calloc, or with mm_malloc and memset
+ *    if it has none
+ */
+static char *zeroed_malloc(int n, int size)
+{
+    char *p;
+
+    if (mm->calloc != NULL)
+	return mm->calloc(n, size);
+    if ((p = mm->malloc((size_t)n * size)) != NULL)
+	memset(p, 0, (size_t)n * size);
+    return p;
+}
+
+/*
+ * hinted_malloc - Allocate size bytes for request opnum of trace, with
+ *    the package's mm_malloc_hint if -L found the block short-lived
+ *    and the package has one
+ */
+static char *hinted_malloc(trace_t *trace, int opnum, int size)
+{
+    if (trace->hints != NULL && trace->hints[opnum] && mm->malloc_hint != NULL)
+	return mm->malloc_hint(size, MM_SHORT_LIVED);
+    return mm->malloc(size);
+}
+
+/*
+ * eval_mm_thread - Body of one -P replay thread. Replays its trace
+ *    PAR_REPS times against the shared mm package, tracking its blocks
+ *    in a private array so the threads never share trace state.
+ */
+static void *eval_mm_thread(void *ptr)
+{
+    thread_t *arg = (thread_t *)ptr;
+    trace_t *trace = arg->trace;
+    int i, rep, index;
+    char *p;
+
+    for (rep = 0; rep < PAR_REPS; rep++) {
+	for (i = 0;  i < trace->num_ops;  i++) {
+	    index = trace->ops[i].index;
+	    switch (trace->ops[i].type) {
+
+	    case ALLOC: /* mm_malloc */
+		if ((p = hinted_malloc(trace, i, trace->ops[i].size)) == NULL) {
+		    arg->ok = 0;
+		    return NULL;
+		}
+		arg->blocks[index] = p;
+		break;
+
+	    case REALLOC: /* mm_realloc */
+		if ((p = mm->realloc(arg->blocks[index], trace->ops[i].size)) == NULL) {
+		    arg->ok = 0;
+		    return NULL;
+		}
+		arg->blocks[index] = p;
+		break;
+
+	    case FREE: /* mm_free */
+		mm->free(arg->blocks[index]);
+		break;
+
+	    case ALLOC_BATCH: /* mm_malloc_batch */
+		if (batch_malloc(trace->ops[i].size, trace->ops[i].count,
+				 arg->blocks + index) != trace->ops[i].count) {
+		    arg->ok = 0;
+		    return NULL;
+		}
+		break;
+
+	    case FREE_BATCH: /* mm_free_batch */
+		batch_free(arg->blocks + index, trace->ops[i].count);
+		break;
+
+	    case MEMALIGN: /* mm_memalign */
+		if ((p = aligned_malloc(trace->ops[i].count, trace->ops[i].size)) == NULL) {
+		    arg->ok = 0;
+		    return NULL;
+		}
+		arg->blocks[index] = p;
+		break;
+
+	    case CALLOC: /* mm_calloc */
+		if ((p = zeroed_malloc(trace->ops[i].count, trace->ops[i].size)) == NULL) {
+		    arg->ok = 0;
+		    return NULL;
+		}
+		arg->blocks[index] = p;
+		break;
+	    }
+	}
+    }
+    return NULL;
+}
+
 /*
  * eval_libc_valid - We run this function to make sure that the
  *    libc malloc can run to completion on the set of traces.
@@ -841,7 +1969,7 @@ static void eval_mm_speed(void *ptr)
  */
 static int eval_libc_valid(trace_t *trace, int tracenum)
 {
-    int i, newsize;
+    int i, j, newsize;
     char *p, *newp, *oldp;
 
     for (i = 0;  i < trace->num_ops;  i++) {
@@ -869,6 +1997,39 @@ static int eval_libc_valid(trace_t *trace, int tracenum)
 	    free(trace->blocks[trace->ops[i].index]);
 	    break;
 
+        case ALLOC_BATCH: /* one malloc per block */
+	    for (j = 0; j < trace->ops[i].count; j++) {
+		if ((p = malloc(trace->ops[i].size)) == NULL) {
+		    malloc_error(tracenum, i, "libc malloc failed");
+		    unix_error("System message");
+		}
+		trace->blocks[trace->ops[i].index + j] = p;
+	    }
+	    break;
+
+        case FREE_BATCH: /* one free per block */
+	    for (j = 0; j < trace->ops[i].count; j++)
+		free(trace->blocks[trace->ops[i].index + j]);
+	    break;
+
+        case MEMALIGN: /* posix_memalign */
+	    if ((j = posix_memalign((void **)&p, trace->ops[i].count,
+				    trace->ops[i].size)) != 0) {
+		errno = j;
+		malloc_error(tracenum, i, "libc posix_memalign failed");
+		unix_error("System message");
+	    }
+	    trace->blocks[trace->ops[i].index] = p;
+	    break;
+
+        case CALLOC: /* calloc */
+	    if ((p = calloc(trace->ops[i].count, trace->ops[i].size)) == NULL) {
+		malloc_error(tracenum, i, "libc calloc failed");
+		unix_error("System message");
+	    }
+	    trace->blocks[trace->ops[i].index] = p;
+	    break;
+
 	default:
 	    app_error("invalid operation type  in eval_libc_valid");
 	}
@@ -884,7 +2045,7 @@ static int eval_libc_valid(trace_t *trace, int tracenum)
  */
 static void eval_libc_speed(void *ptr)
 {
-    int i;
+    int i, j;
     int index, size, newsize;
     char *p, *newp, *oldp, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
@@ -914,6 +2075,33 @@ static void eval_libc_speed(void *ptr)
 	    block = trace->blocks[index];
 	    free(block);
 	    break;
+
+        case ALLOC_BATCH: /* one malloc per block */
+	    index = trace->ops[i].index;
+	    for (j = 0; j < trace->ops[i].count; j++)
+		if ((trace->blocks[index + j] = malloc(trace->ops[i].size)) == NULL)
+		    unix_error("malloc failed in eval_libc_speed");
+	    break;
+
+        case FREE_BATCH: /* one free per block */
+	    index = trace->ops[i].index;
+	    for (j = 0; j < trace->ops[i].count; j++)
+		free(trace->blocks[index + j]);
+	    break;
+
+        case MEMALIGN: /* posix_memalign */
+	    index = trace->ops[i].index;
+	    if (posix_memalign((void **)&trace->blocks[index], trace->ops[i].count,
+			       trace->ops[i].size) != 0)
+		app_error("posix_memalign failed in eval_libc_speed");
+	    break;
+
+        case CALLOC: /* calloc */
+	    index = trace->ops[i].index;
+	    if ((p = calloc(trace->ops[i].count, trace->ops[i].size)) == NULL)
+		unix_error("calloc failed in eval_libc_speed");
+	    trace->blocks[index] = p;
+	    break;
 	}
     }
 }
@@ -923,28 +2111,119 @@ static void eval_libc_speed(void *ptr)
  ************************************/
 
 
+/*
+ * run_jobs - Call job(i, tracefiles[i], &stats[i]) for each of the n
+ *    traces. With njobs > 1 the calls run in worker processes, up to
+ *    njobs at once, each on a private copy of the heap and of the mm
+ *    package's state, so stats must be in shared memory. A worker
+ *    passes back its error count as its exit status; a worker that
+ *    exits early or is killed fails its trace.
+ */
+static void run_jobs(int n, char **tracefiles, stats_t *stats, int njobs,
+		     void (*job)(int tracenum, char *tracefile, stats_t *stats))
+{
+    int i, next, running, status;
+    pid_t pid, *pids;
+
+    if (njobs <= 1 || n <= 1) {
+	for (i = 0; i < n; i++)
+	    job(i, tracefiles[i], &stats[i]);
+	return;
+    }
+
+    if ((pids = (pid_t *)calloc(n, sizeof(pid_t))) == NULL)
+	unix_error("calloc failed in run_jobs");
+    fflush(stdout);  /* or every worker would print it again */
+    for (next = running = 0; next < n || running > 0; ) {
+	if (next < n && running < njobs) {
+	    if ((pid = fork()) < 0)
+		unix_error("fork failed in run_jobs");
+	    if (pid == 0) {
+		/* print this trace's lines in one piece, at exit */
+		setvbuf(stdout, NULL, _IOFBF, 1 << 16);
+		if (hw_counters) {
+		    close_hw_counters();  /* they count the driver */
+		    init_hw_counters();
+		}
+		errors = 0;
+		job(next, tracefiles[next], &stats[next]);
+		exit(errors < 255 ? errors : 255);
+	    }
+	    pids[next++] = pid;
+	    running++;
+	    continue;
+	}
+
+	if ((pid = wait(&status)) < 0)
+	    unix_error("wait failed in run_jobs");
+	running--;
+	for (i = 0; pids[i] != pid; i++)
+	    ;
+	if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+	    continue;
+	stats[i].valid = 0;
+	if (WIFSIGNALED(status)) {
+	    printf("ERROR [trace %d]: killed by signal %d\n", i, WTERMSIG(status));
+	    errors++;
+	}
+	else
+	    errors += WEXITSTATUS(status);
+    }
+    free(pids);
+}
+
+/*
+ * shared_calloc - Allocate a zeroed array that worker processes can
+ *    write and the driver read back. It is never freed.
+ */
+static void *shared_calloc(size_t n, size_t size)
+{
+    void *p;
+
+    p = mmap(NULL, n * size, PROT_READ | PROT_WRITE,
+	     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+	unix_error("mmap failed in shared_calloc");
+    return p;
+}
+
 /*
  * printresults - prints a performance summary for some malloc package
  */
 static void printresults(int n, stats_t *stats) 
 {
-    int i;
+    static char *hw_names[NUM_COUNTERS] = {
+	"L1D/op", "LLC/op", "brmis/op", "dTLB/op", "pgflt/op"
+    };
+    int i, j;
     double secs = 0;
     double ops = 0;
     double util = 0;
 
     /* Print the individual results for each trace */
-    printf("%5s%7s %5s%8s%10s%6s\n", 
-	   "trace", " valid", "util", "ops", "secs", "Kops");
+    printf("%5s%7s %5s%8s%10s%6s%8s%8s", 
+	   "trace", " valid", "util", "ops", "secs", "Kops", "spanKB", "endKB");
+    for (j = 0; hw_counters && j < NUM_COUNTERS; j++)
+	printf("%10s", hw_names[j]);
+    printf("\n");
     for (i=0; i < n; i++) {
 	if (stats[i].valid) {
-	    printf("%2d%10s%5.0f%%%8.0f%10.6f%6.0f\n", 
+	    printf("%2d%10s%5.0f%%%8.0f%10.6f%6.0f%8.0f%8.0f", 
 		   i,
 		   "yes",
 		   stats[i].util*100.0,
 		   stats[i].ops,
 		   stats[i].secs,
-		   (stats[i].ops/1e3)/stats[i].secs);
+		   (stats[i].ops/1e3)/stats[i].secs,
+		   stats[i].peak_span,
+		   stats[i].end_rss);
+	    for (j = 0; hw_counters && j < NUM_COUNTERS; j++) {
+		if (stats[i].hw[j] < 0)
+		    printf("%10s", "-");
+		else
+		    printf("%10.4f", stats[i].hw[j] / stats[i].ops);
+	    }
+	    printf("\n");
 	    secs += stats[i].secs;
 	    ops += stats[i].ops;
 	    util += stats[i].util;
@@ -980,6 +2259,111 @@ static void printresults(int n, stats_t *stats)
 
 }
 
+/*
+ * printlatency - prints the latency percentiles of each request type
+ *     on each trace, and unless csvfile is "-" writes every nonempty
+ *     histogram bucket to it as CSV
+ */
+static void printlatency(int n, stats_t *stats, char *csvfile) 
+{
+    static char *names[NUM_REQTYPES] = {
+	"malloc", "free", "realloc", "malloc_batch", "free_batch", "memalign",
+	"calloc"
+    };
+    FILE *csv = NULL;
+    hist_t *h;
+    unsigned long cum;
+    int i, t, b;
+
+    if (strcmp(csvfile, "-") != 0) {
+	if ((csv = fopen(csvfile, "w")) == NULL)
+	    unix_error("Could not open latency CSV file");
+	fprintf(csv, "trace,op,lo,hi,count,percentile\n");
+    }
+
+    printf("Latency in cycles for mm malloc:\n");
+    printf("%5s%14s%8s%8s%8s%8s%8s%10s\n", 
+	   "trace", "op", "count", "p50", "p90", "p99", "p99.9", "max");
+    for (i = 0; i < n; i++) {
+	if (stats[i].lat == NULL)
+	    continue;
+	for (t = 0; t < NUM_REQTYPES; t++) {
+	    h = &stats[i].lat[t];
+	    if (h->total == 0)
+		continue;
+	    printf("%5d%14s%8lu%8lu%8lu%8lu%8lu%10lu\n", 
+		   i, names[t], h->total,
+		   hist_value(h, 0.5),
+		   hist_value(h, 0.9),
+		   hist_value(h, 0.99),
+		   hist_value(h, 0.999),
+		   h->max);
+	    if (csv == NULL)
+		continue;
+	    for (b = 0, cum = 0; b < HIST_BUCKETS; b++) {
+		if (h->count[b] == 0)
+		    continue;
+		cum += h->count[b];
+		fprintf(csv, "%d,%s,%lu,%lu,%lu,%.6f\n", i, names[t],
+			b ? hist_hi(b-1) + 1 : 0, hist_hi(b), h->count[b],
+			100.0 * cum / h->total);
+	    }
+	}
+    }
+    printf("\n");
+    if (csv != NULL)
+	fclose(csv);
+}
+
+/*
+ * hist_add - Count one latency of v cycles in histogram h
+ */
+static void hist_add(hist_t *h, unsigned long v)
+{
+    int e, b;
+
+    if (v < 2*HIST_SUB)
+	b = v;
+    else {
+	for (e = HIST_SUB_BITS + 1; (v >> e) > 1; e++)
+	    ;                  /* e = floor(log2(v)) */
+	b = (e - HIST_SUB_BITS) * HIST_SUB + (v >> (e - HIST_SUB_BITS));
+    }
+    h->count[b]++;
+    h->total++;
+    if (v > h->max)
+	h->max = v;
+}
+
+/*
+ * hist_hi - Return the largest value that falls in bucket b
+ */
+static unsigned long hist_hi(int b)
+{
+    int shift;
+
+    if (b < 2*HIST_SUB)
+	return b;
+    shift = b / HIST_SUB - 1;
+    return ((unsigned long)(b % HIST_SUB + HIST_SUB + 1) << shift) - 1;
+}
+
+/*
+ * hist_value - Return an upper bound on the q-quantile of histogram h
+ */
+static unsigned long hist_value(hist_t *h, double q)
+{
+    unsigned long cum = 0;
+    int b;
+
+    for (b = 0; b < HIST_BUCKETS; b++) {
+	cum += h->count[b];
+	if (cum >= q * h->total)
+	    break;
+    }
+    return hist_hi(b) < h->max ? hist_hi(b) : h->max;
+}
+
 /* 
  * app_error - Report an arbitrary application error
  */
@@ -1012,14 +2396,25 @@ void malloc_error(int tracenum, int opnum, char *msg)
  */
 static void usage(void) 
 {
-    fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>]\n");
+    fprintf(stderr, "Usage: mdriver [-hvValC] [-c <n>] [-j <n>] [-f <file>] [-t <dir>] [-P <n>] [-H <csv>] [-F <csv> [-k <n>]]\n"
+	    "               [-L <n>] [-T] [-m <lib.so>]...\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-a         Don't check the team structure.\n");
+    fprintf(stderr, "\t-c <n>     Run mm_checkheap every <n> requests (0 = adaptive).\n");
+    fprintf(stderr, "\t-C         Count cache, branch, TLB misses and page faults per op.\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
+    fprintf(stderr, "\t-F <csv>   Sample live bytes, heap size and free blocks to <csv>.\n");
     fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
     fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-H <csv>   Histogram per-request latencies, buckets to <csv> (or -).\n");
+    fprintf(stderr, "\t-j <n>     Evaluate <n> traces at once in worker processes (0 = #cores).\n");
+    fprintf(stderr, "\t-k <n>     Requests between -F samples (%d).\n", FRAG_EVERY);
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+    fprintf(stderr, "\t-L <n>     Hint blocks freed within <n> requests as short-lived.\n");
+    fprintf(stderr, "\t-m <lib>   Compare with the allocator in shared object <lib>.\n");
+    fprintf(stderr, "\t-P <n>     Replay traces concurrently on 1..n threads (0 = #cores).\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
+    fprintf(stderr, "\t-T         Print the -m comparison one allocator per row.\n");
     fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
     fprintf(stderr, "\t-V         Print additional debug info.\n");
 }
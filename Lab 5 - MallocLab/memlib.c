@@ -10,6 +10,7 @@
 #include <sys/mman.h>
 #include <string.h>
 #include <errno.h>
+#include <pthread.h>
 
 #include "memlib.h"
 #include "config.h"
@@ -18,20 +19,47 @@
 static char *mem_start_brk;  /* points to first byte of heap */
 static char *mem_brk;        /* points to last byte of heap */
 static char *mem_max_addr;   /* largest legal heap address */ 
+static char *mem_commit;     /* end of the readable/writable pages */
+static char *mem_peak_brk;   /* highest brk since the last reset */
+static char *mem_dirty;      /* end of the bytes sbrk has handed out since
+				their pages were committed or released */
+static pthread_mutex_t brk_lock = PTHREAD_MUTEX_INITIALIZER; /* guards mem_brk */
+
+/* Where to reserve the heap: anywhere, or at HEAP_START if a test build
+   pins it there */
+#ifdef HEAP_START
+#define HEAP_HINT   ((void *)(HEAP_START))
+#define HEAP_FIXED  MAP_FIXED_NOREPLACE
+#else
+#define HEAP_HINT   NULL
+#define HEAP_FIXED  0
+#endif
+
+/* Round address p up to a page boundary */
+#define PAGE_UP(p)  ((char *)(((size_t)(p) + mem_pagesize()-1) & ~(mem_pagesize()-1)))
+
+static void mem_release(char *lo);
 
 /* 
- * mem_init - initialize the memory system model
+ * mem_init - initialize the memory system model. The MAX_HEAP bytes of
+ *    address space are only reserved here; mem_sbrk commits pages as
+ *    the brk reaches them.
  */
 void mem_init(void)
 {
-    /* allocate the storage we will use to model the available VM */
-    if ((mem_start_brk = (char *)malloc(MAX_HEAP)) == NULL) {
-	fprintf(stderr, "mem_init_vm: malloc error\n");
+    mem_start_brk = mmap(HEAP_HINT, MAX_HEAP, PROT_NONE,
+			 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | HEAP_FIXED,
+			 -1, 0);
+    if (mem_start_brk == MAP_FAILED) {
+	fprintf(stderr, "mem_init_vm: mmap error\n");
 	exit(1);
     }
 
     mem_max_addr = mem_start_brk + MAX_HEAP;  /* max legal heap address */
     mem_brk = mem_start_brk;                  /* heap is empty initially */
+    mem_commit = mem_start_brk;
+    mem_peak_brk = mem_start_brk;
+    mem_dirty = mem_start_brk;
 }
 
 /* 
@@ -39,35 +67,104 @@ void mem_init(void)
  */
 void mem_deinit(void)
 {
-    free(mem_start_brk);
+    munmap(mem_start_brk, MAX_HEAP);
 }
 
 /*
- * mem_reset_brk - reset the simulated brk pointer to make an empty heap
+ * mem_reset_brk - reset the simulated brk pointer to make an empty heap.
+ *    The committed pages are kept, so that replaying a trace many times
+ *    does not time page faults; they no longer count toward mem_rss().
  */
 void mem_reset_brk()
 {
+    pthread_mutex_lock(&brk_lock);
     mem_brk = mem_start_brk;
+    mem_peak_brk = mem_start_brk;
+    pthread_mutex_unlock(&brk_lock);
 }
 
 /* 
  * mem_sbrk - simple model of the sbrk function. Extends the heap 
- *    by incr bytes and returns the start address of the new area. In
- *    this model, the heap cannot be shrunk.
+ *    by incr bytes and returns the start address of the new area. A
+ *    negative incr shrinks the heap, and the pages wholly above the new
+ *    brk are given back to the system. Safe to call from several
+ *    threads at once. incr is as wide as a pointer, so a heap of more
+ *    than 2 GB can be grown or shrunk by any amount.
  */
-void *mem_sbrk(int incr) 
+void *mem_sbrk(intptr_t incr) 
 {
-    char *old_brk = mem_brk;
+    char *old_brk;
 
-    if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
+    pthread_mutex_lock(&brk_lock);
+    old_brk = mem_brk;
+    if (incr > mem_max_addr - mem_brk || incr < mem_start_brk - mem_brk) {
+	pthread_mutex_unlock(&brk_lock);
 	errno = ENOMEM;
 	fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
 	return (void *)-1;
     }
     mem_brk += incr;
+
+    if (mem_brk > mem_commit) {
+	/* commit the pages the brk just moved onto */
+	if (mprotect(mem_commit, PAGE_UP(mem_brk) - mem_commit, 
+		     PROT_READ | PROT_WRITE) < 0) {
+	    mem_brk = old_brk;
+	    pthread_mutex_unlock(&brk_lock);
+	    fprintf(stderr, "ERROR: mem_sbrk failed. Could not commit pages...\n");
+	    return (void *)-1;
+	}
+	mem_commit = PAGE_UP(mem_brk);
+    }
+    else if (incr < 0)
+	mem_release(PAGE_UP(mem_brk));  /* the pages the brk left behind */
+
+    if (mem_brk > mem_peak_brk)
+	mem_peak_brk = mem_brk;
+    if (mem_brk > mem_dirty)
+	mem_dirty = mem_brk;
+    pthread_mutex_unlock(&brk_lock);
     return (void *)old_brk;
 }
 
+/*
+ * mem_release - give the committed pages from lo up back to the system.
+ *    The caller holds brk_lock.
+ */
+static void mem_release(char *lo)
+{
+    if (lo >= mem_commit)
+	return;
+    madvise(lo, mem_commit - lo, MADV_DONTNEED);
+    mprotect(lo, mem_commit - lo, PROT_NONE);
+    mem_commit = lo;
+    if (mem_dirty > lo)
+	mem_dirty = lo;       /* they come back zero-filled */
+}
+
+/*
+ * mem_fresh_lo - return the address from which no heap byte has been
+ *    handed out by mem_sbrk since its page was committed or released,
+ *    so every byte from there on that mem_sbrk hands out next is zero
+ */
+void *mem_fresh_lo()
+{
+    return (void *)mem_dirty;
+}
+
+/*
+ * mem_lock, mem_unlock - hold the brk still, e.g. across a fork
+ */
+void mem_lock()
+{
+    pthread_mutex_lock(&brk_lock);
+}
+
+void mem_unlock()
+{
+    pthread_mutex_unlock(&brk_lock);
+}
+
 /*
  * mem_heap_lo - return address of the first heap byte
  */
@@ -92,6 +189,45 @@ size_t mem_heapsize()
     return (size_t)(mem_brk - mem_start_brk);
 }
 
+/*
+ * mem_heap_peak() - returns the largest heap size in bytes since the
+ *    last reset
+ */
+size_t mem_heap_peak()
+{
+    return (size_t)(mem_peak_brk - mem_start_brk);
+}
+
+/*
+ * mem_rss() - returns the bytes of the pages up to the brk that are
+ *    resident in memory
+ */
+size_t mem_rss()
+{
+    size_t i, n, rss = 0;
+    unsigned char *vec;
+
+    n = (PAGE_UP(mem_brk) - mem_start_brk) / mem_pagesize();
+    if (n == 0 || (vec = malloc(n)) == NULL)
+	return 0;
+    if (mincore(mem_start_brk, n * mem_pagesize(), vec) == 0) {
+	for (i = 0; i < n; i++)
+	    rss += vec[i] & 1;
+    }
+    free(vec);
+    return rss * mem_pagesize();
+}
+
+/*
+ * mem_peak_span() - returns the most pages, in bytes, the heap spanned at
+ *    once since the last reset. This is the peak brk rounded up to a
+ *    page, an upper bound on the peak resident size, not a measure of it.
+ */
+size_t mem_peak_span()
+{
+    return (size_t)(PAGE_UP(mem_peak_brk) - mem_start_brk);
+}
+
 /*
  * mem_pagesize() - returns the page size of the system
  */
@@ -1,11 +1,17 @@
 #include <unistd.h>
+#include <stdint.h>
 
 void mem_init(void);               
 void mem_deinit(void);
-void *mem_sbrk(int incr);
+void *mem_sbrk(intptr_t incr);
 void mem_reset_brk(void); 
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
+size_t mem_heap_peak(void);
+size_t mem_rss(void);
+size_t mem_peak_span(void);
 size_t mem_pagesize(void);
-
+void *mem_fresh_lo(void);
+void mem_lock(void);
+void mem_unlock(void);
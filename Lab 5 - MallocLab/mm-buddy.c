@@ -0,0 +1,505 @@
+/*
+ * mm-buddy.c - Binary buddy allocator behind the mm.h interface
+ *
+ * Every block is 2^k bytes, MIN_ORDER <= k < HEAP_ORDER, and starts at
+ * an offset from the base that is a multiple of its size, so the two
+ * halves of a block of order k+1 are buddies whose offsets differ only
+ * in bit k. The base is the heap's start rounded down to a multiple of
+ * 2^(HEAP_ORDER-1), the largest block size, so blocks are aligned on
+ * their size in memory too, and mm_memalign need only raise the order.
+ * Requests are rounded up to a power of two and carry no header or
+ * footer: a block's order is found from its offset in a bitmap of buddy
+ * states instead.
+ *
+ * The state bitmaps describe the complete binary tree of all the blocks
+ * the 2^HEAP_ORDER bytes from the base could hold, the heap being the
+ * part from start on. The heap starts in the first half of the tree and
+ * is at most half as large, so it always fits in it. Node (k, off) is
+ * the block of order k at offset off, and it has two bits:
+ *
+ *   split  the block is divided into its two halves
+ *   free   the block is whole and on the free list of its order
+ *
+ * A block that is neither is allocated, or lies past the top of the
+ * heap. Only the bits of whole blocks and their ancestors mean
+ * anything; those of the nodes inside a block are stale, and are
+ * cleared when a split or a carve makes a node a whole block again.
+ * Freeing walks down from the root along split nodes to the block
+ * holding the pointer, and merges it with its buddy for as long as the
+ * buddy is free, clearing its parent's split bit each time. Allocating
+ * takes the smallest free block of a large enough order, and splits it
+ * in halves, putting each upper half on its free list, until it is the
+ * right size.
+ *
+ * The heap grows like a wilderness: everything from top to the end of
+ * memlib's address space is free but in no list. When no list has a
+ * large enough block, the block is carved from top, which is first
+ * rounded up to the block's size; the gap this leaves is put on the
+ * free lists as the largest aligned blocks that fill it. memlib only
+ * has to back the heap up to top. A freed block that ends at top, and
+ * the free blocks below it, are given back to the wilderness, so the
+ * heap can shrink back down before it grows again.
+ *
+ * Free blocks are doubly linked through their first two words, so that
+ * a merge can unlink a buddy in constant time, and a bit per order says
+ * which lists are non-empty. Split and merge therefore take
+ * O(HEAP_ORDER) steps. One lock serializes all the calls.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "config.h"
+
+/* $begin buddymacros */
+/* Orders of the smallest block (two list pointers) and of the root */
+#define MIN_ORDER   4
+#ifndef HEAP_ORDER
+#define HEAP_ORDER  26
+#endif
+
+/* the heap starts in the first half of the root, and must fit in the rest */
+#if MAX_HEAP > (1L << (HEAP_ORDER - 1))
+#error "HEAP_ORDER is too small for MAX_HEAP"
+#endif
+
+/* Bitmap index of node (k, off): the root is 1, the children of n are 2n, 2n+1 */
+#define NODE(k, off)   (((size_t)1 << (HEAP_ORDER - (k))) + ((off) >> (k)))
+#define NODES          ((size_t)1 << (HEAP_ORDER - MIN_ORDER + 1))
+
+/* Read, set and clear bit n of bitmap map */
+#define BIT(map, n)      ((map)[(n) >> 3] & (1 << ((n) & 7)))
+#define SET_BIT(map, n)  ((map)[(n) >> 3] |= (1 << ((n) & 7)))
+#define CLR_BIT(map, n)  ((map)[(n) >> 3] &= ~(1 << ((n) & 7)))
+
+/* Size of a block of order k, and address of the block at offset off */
+#define BLOCK(k)       ((size_t)1 << (k))
+#define ADDR(off)      (heap_base + (off))
+#define OFFSET(p)      ((size_t)((char *)(p) - heap_base))
+
+/* Free list links, in the first two words of a free block */
+#define NEXT(bp)       (((char **)(bp))[0])
+#define PREV(bp)       (((char **)(bp))[1])
+/* $end buddymacros */
+
+#define CHECK_ERROR(...)  (check_errors++, printf(__VA_ARGS__))
+
+/* Global variables */
+static char *heap_base;                      /* offset 0 */
+static size_t start;                         /* offset of the heap */
+static size_t top;                           /* offset of the wilderness */
+static size_t high_top;                      /* largest top since the bitmaps were clear */
+static char *free_lists[HEAP_ORDER];         /* free blocks of each order */
+static unsigned long nonempty;               /* bit k set iff free_lists[k] has a block */
+static unsigned char split_map[NODES / 8];   /* split bit of each node */
+static unsigned char free_map[NODES / 8];    /* free bit of each node */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static int check_errors;                     /* errors found by mm_checkheap */
+
+/* Function prototypes for internal helper routines */
+static int order_of(size_t size);
+static void *alloc_block(int k);
+static void *carve_block(int k);
+static void free_block(size_t off, int k);
+static void find_block(void *p, size_t *off, int *k);
+static void push_block(size_t off, int k);
+static void unlink_block(size_t off, int k);
+static void retreat_top(void);
+static int grow_in_place(size_t off, int k, int want);
+static void clear_maps(size_t lo, size_t hi);
+int mm_checkheap(int verbose);
+void mm_freestats(size_t *count, size_t *largest);
+
+/*
+ * mm_init - Initialize the memory manager, with the whole heap in the
+ *     wilderness
+ */
+int mm_init(void)
+{
+    if (high_top > start)
+	clear_maps(start, high_top);
+    memset(free_lists, 0, sizeof(free_lists));
+    nonempty = 0;
+    heap_base = (char *)((size_t)mem_heap_lo() & ~(BLOCK(HEAP_ORDER - 1) - 1));
+    start = top = high_top = OFFSET(mem_heap_lo());
+    return 0;
+}
+
+/*
+ * mm_malloc - Allocate a block of the smallest order that holds size bytes
+ */
+void *mm_malloc(size_t size)
+{
+    void *bp;
+    int k;
+
+    if (size == 0 || (k = order_of(size)) < 0)
+	return NULL;
+    pthread_mutex_lock(&lock);
+    bp = alloc_block(k);
+    pthread_mutex_unlock(&lock);
+    return bp;
+}
+
+/*
+ * mm_free - Free a block, merging it with its buddies
+ */
+void mm_free(void *bp)
+{
+    size_t off;
+    int k;
+
+    if (bp == NULL)
+	return;
+    pthread_mutex_lock(&lock);
+    find_block(bp, &off, &k);
+    free_block(off, k);
+    pthread_mutex_unlock(&lock);
+}
+
+/*
+ * mm_realloc - Resize a block. It stays put if the new size still fits
+ *     its order, or if it can absorb enough of its free upper buddies.
+ */
+void *mm_realloc(void *ptr, size_t size)
+{
+    void *newp;
+    size_t off;
+    int k, want;
+
+    if (ptr == NULL)
+	return mm_malloc(size);
+    if (size == 0) {
+	mm_free(ptr);
+	return NULL;
+    }
+    if ((want = order_of(size)) < 0)
+	return NULL;
+
+    pthread_mutex_lock(&lock);
+    find_block(ptr, &off, &k);
+    if (want <= k || grow_in_place(off, k, want)) {
+	pthread_mutex_unlock(&lock);
+	return ptr;
+    }
+    if ((newp = alloc_block(want)) != NULL) {
+	memcpy(newp, ptr, BLOCK(k));
+	free_block(off, k);
+    }
+    pthread_mutex_unlock(&lock);
+    return newp;
+}
+
+/*
+ * mm_memalign - Allocate size bytes on an alignment boundary, which a
+ *     block of at least alignment bytes is on already
+ */
+void *mm_memalign(size_t alignment, size_t size)
+{
+    if (size == 0)
+	return NULL;
+    return mm_malloc(size < alignment ? alignment : size);
+}
+
+/*
+ * mm_calloc - Allocate a zero-filled array of nmemb elements of size
+ *     bytes each
+ */
+void *mm_calloc(size_t nmemb, size_t size)
+{
+    void *bp;
+
+    if (size != 0 && nmemb > (size_t)-1 / size)
+	return NULL;
+    if ((bp = mm_malloc(nmemb * size)) != NULL)
+	memset(bp, 0, nmemb * size);
+    return bp;
+}
+
+/*
+ * The remaining routines are internal helper routines
+ */
+
+/*
+ * order_of - Return the order of the smallest block that holds size
+ *     bytes, or -1 if no block is that large
+ */
+static int order_of(size_t size)
+{
+    int k = MIN_ORDER;
+
+    if (size > BLOCK(HEAP_ORDER - 1))
+	return -1;
+    while (BLOCK(k) < size)
+	k++;
+    return k;
+}
+
+/*
+ * alloc_block - Allocate a block of order k, splitting the smallest
+ *     free block that is large enough or carving it from the wilderness
+ */
+static void *alloc_block(int k)
+{
+    unsigned long avail = nonempty & ~(BLOCK(k) - 1);
+    size_t off;
+    int j;
+
+    if (avail == 0)
+	return carve_block(k);
+
+    j = __builtin_ctzl(avail);
+    off = OFFSET(free_lists[j]);
+    unlink_block(off, j);
+    while (j > k) {                  /* keep the lower half, free the upper */
+	SET_BIT(split_map, NODE(j, off));
+	j--;
+	push_block(off + BLOCK(j), j);
+    }
+    CLR_BIT(split_map, NODE(k, off));
+    return ADDR(off);
+}
+
+/*
+ * carve_block - Allocate a block of order k at the top of the heap,
+ *     putting the gap below its boundary on the free lists
+ */
+static void *carve_block(int k)
+{
+    size_t off = (top + BLOCK(k)-1) & ~(BLOCK(k)-1);
+    size_t gap, end = off + BLOCK(k);
+    char *brk = (char *)mem_heap_hi() + 1;
+    int i, j;
+
+    if (end > start + MAX_HEAP)
+	return NULL;
+    if (ADDR(end) > brk && mem_sbrk(ADDR(end) - brk) == (void *)-1)
+	return NULL;
+
+    /* every ancestor is split; the block itself may hold stale bits */
+    for (i = HEAP_ORDER; i > k; i--)
+	SET_BIT(split_map, NODE(i, off));
+    CLR_BIT(split_map, NODE(k, off));
+
+    /* the gap is filled by ascending aligned blocks, the largest it can,
+       whose ancestors may reach below start and be unmarked */
+    for (gap = top; gap < off; gap += BLOCK(j)) {
+	j = __builtin_ctzl(gap);
+	while (gap + BLOCK(j) > off)
+	    j--;
+	for (i = HEAP_ORDER; i > j; i--)
+	    SET_BIT(split_map, NODE(i, gap));
+	push_block(gap, j);
+    }
+
+    top = end;
+    if (top > high_top)
+	high_top = top;
+    return ADDR(off);
+}
+
+/*
+ * free_block - Free the block of order k at off, merging it with its
+ *     buddy for as long as that is free
+ */
+static void free_block(size_t off, int k)
+{
+    size_t buddy;
+
+    while (k < HEAP_ORDER - 1) {
+	buddy = off ^ BLOCK(k);
+	if (!BIT(free_map, NODE(k, buddy)))
+	    break;
+	unlink_block(buddy, k);
+	off &= ~BLOCK(k);
+	k++;
+	CLR_BIT(split_map, NODE(k, off));
+    }
+
+    if (off + BLOCK(k) == top) {
+	top = off;
+	retreat_top();
+    }
+    else
+	push_block(off, k);
+}
+
+/*
+ * find_block - Find the offset and order of the block that holds p,
+ *     walking down from the root along split nodes
+ */
+static void find_block(void *p, size_t *off, int *k)
+{
+    size_t o = OFFSET(p);
+    int j = HEAP_ORDER;
+
+    while (j > MIN_ORDER && BIT(split_map, NODE(j, o)))
+	j--;
+    *off = o & ~(BLOCK(j) - 1);
+    *k = j;
+}
+
+/*
+ * push_block - Put the block of order k at off on its free list. Its
+ *     split bit may be stale, from before it was merged or carved.
+ */
+static void push_block(size_t off, int k)
+{
+    char *bp = ADDR(off);
+
+    NEXT(bp) = free_lists[k];
+    PREV(bp) = NULL;
+    if (free_lists[k] != NULL)
+	PREV(free_lists[k]) = bp;
+    free_lists[k] = bp;
+    nonempty |= BLOCK(k);
+    SET_BIT(free_map, NODE(k, off));
+    CLR_BIT(split_map, NODE(k, off));
+}
+
+/*
+ * unlink_block - Take the block of order k at off off its free list
+ */
+static void unlink_block(size_t off, int k)
+{
+    char *bp = ADDR(off);
+
+    if (PREV(bp) != NULL)
+	NEXT(PREV(bp)) = NEXT(bp);
+    else if ((free_lists[k] = NEXT(bp)) == NULL)
+	nonempty &= ~BLOCK(k);
+    if (NEXT(bp) != NULL)
+	PREV(NEXT(bp)) = PREV(bp);
+    CLR_BIT(free_map, NODE(k, off));
+}
+
+/*
+ * retreat_top - Give the free blocks that end at top back to the
+ *     wilderness
+ */
+static void retreat_top(void)
+{
+    size_t off;
+    int k;
+
+    while (top > start) {
+	find_block(ADDR(top - 1), &off, &k);
+	if (!BIT(free_map, NODE(k, off)))
+	    break;
+	unlink_block(off, k);
+	top = off;
+    }
+}
+
+/*
+ * grow_in_place - Try to make the block of order k at off one of order
+ *     want by absorbing the buddies above it, each of which must be
+ *     free or in the wilderness. Returns 0, changing nothing, if it can't.
+ */
+static int grow_in_place(size_t off, int k, int want)
+{
+    size_t end = off + BLOCK(want);
+    char *brk = (char *)mem_heap_hi() + 1;
+    int j;
+
+    if (off & (BLOCK(want) - 1) || end > start + MAX_HEAP)
+	return 0;                    /* not the lower half at every step */
+    for (j = k; j < want; j++)
+	if (off + BLOCK(j) < top && !BIT(free_map, NODE(j, off + BLOCK(j))))
+	    return 0;
+    if (end > top && ADDR(end) > brk && mem_sbrk(ADDR(end) - brk) == (void *)-1)
+	return 0;
+
+    for (j = k; j < want; j++) {
+	if (off + BLOCK(j) < top)
+	    unlink_block(off + BLOCK(j), j);
+	CLR_BIT(split_map, NODE(j + 1, off));
+    }
+    if (end > top)
+	top = end;
+    if (top > high_top)
+	high_top = top;
+    return 1;
+}
+
+/*
+ * clear_maps - Clear the bits of every node that overlaps offsets lo
+ *     to hi. Whole bytes are cleared, since all the bits are zero after.
+ */
+static void clear_maps(size_t lo, size_t hi)
+{
+    size_t first, last;
+    int k;
+
+    for (k = MIN_ORDER; k <= HEAP_ORDER; k++) {
+	first = NODE(k, lo);
+	last = NODE(k, hi - 1) + 1;
+	memset(split_map + (first >> 3), 0, ((last + 7) >> 3) - (first >> 3));
+	memset(free_map + (first >> 3), 0, ((last + 7) >> 3) - (first >> 3));
+    }
+}
+
+/*
+ * mm_checkheap - Check that every block on a free list is marked free,
+ *     is found by the walk from the root, lies below top, and has no
+ *     free buddy, that the lists agree with nonempty, and that no free
+ *     block ends at top. Returns the number of errors found.
+ */
+int mm_checkheap(int verbose)
+{
+    char *bp, *prev;
+    size_t off, o;
+    int k, j;
+
+    check_errors = 0;
+    for (k = 0; k < HEAP_ORDER; k++) {
+	if (!(nonempty & BLOCK(k)) != (free_lists[k] == NULL))
+	    CHECK_ERROR("Error: list of order %d and its nonempty bit disagree\n", k);
+	prev = NULL;
+	for (bp = free_lists[k]; bp != NULL; prev = bp, bp = NEXT(bp)) {
+	    if (verbose)
+		printf("%p: free, order %d\n", bp, k);
+	    if (k < MIN_ORDER || (char *)bp < ADDR(start) ||
+		(off = OFFSET(bp)) & (BLOCK(k) - 1) || off + BLOCK(k) > top) {
+		CHECK_ERROR("Error: %p is not a block of order %d below top\n", bp, k);
+		break;
+	    }
+	    if (PREV(bp) != prev)
+		CHECK_ERROR("Error: %p's prev pointer is %p, not %p\n", bp, PREV(bp), prev);
+	    if (!BIT(free_map, NODE(k, off)))
+		CHECK_ERROR("Error: %p is on a free list but not marked free\n", bp);
+	    find_block(bp, &o, &j);
+	    if (o != off || j != k)
+		CHECK_ERROR("Error: %p is found as a block of order %d\n", bp, j);
+	    if (k < HEAP_ORDER - 1 && BIT(free_map, NODE(k, off ^ BLOCK(k))))
+		CHECK_ERROR("Error: %p and its buddy are both free\n", bp);
+	}
+    }
+    if (top > start) {
+	find_block(ADDR(top - 1), &off, &k);
+	if (BIT(free_map, NODE(k, off)))
+	    CHECK_ERROR("Error: free block %p ends at top\n", ADDR(off));
+    }
+    if ((char *)mem_heap_hi() + 1 < ADDR(top))
+	CHECK_ERROR("Error: top %p is past the brk\n", ADDR(top));
+    return check_errors;
+}
+
+/*
+ * mm_freestats - Count the free blocks and find the size of the largest
+ */
+void mm_freestats(size_t *count, size_t *largest)
+{
+    char *bp;
+    int k;
+
+    *count = *largest = 0;
+    for (k = MIN_ORDER; k < HEAP_ORDER; k++)
+	for (bp = free_lists[k]; bp != NULL; bp = NEXT(bp)) {
+	    (*count)++;
+	    *largest = BLOCK(k);
+	}
+}
@@ -1,46 +1,150 @@
 /*
- * mm-implicit.c -  Simple allocator based on implicit free lists,
- *                  first fit placement, and boundary tag coalescing.
+ * mm.c -  Allocator based on segregated free lists (two-level
+ *         segregated fit, a.k.a. TLSF) and boundary tag coalescing.
  *
- * Each block has header and footer of the form:
+ * Each block has an 8-byte header of the form:
  *
- *      31                     3  2  1  0
+ *      63                     3  2  1  0
  *      -----------------------------------
- *     | s  s  s  s  ... s  s  s  0  0  a/f
+ *     | s  s  s  s  ... s  s  s  0 pa a/f
  *      -----------------------------------
  *
- * where s are the meaningful size bits and a/f is set
- * iff the block is allocated. The list has the following form:
+ * where s are the meaningful size bits, a/f is set iff the block is
+ * allocated, and pa is set iff the previous block is allocated. Only
+ * free blocks repeat the size in a footer; an allocated block's last
+ * word is payload, since the footer is only ever read to find a free
+ * predecessor when coalescing, and pa already says whether that is
+ * needed. The heap is a sequence of segments, each of the form:
  *
  * begin                                                          end
- * heap                                                           heap
+ * segment                                                    segment
  *  -----------------------------------------------------------------
- * |  pad   | hdr(8:a) | ftr(8:a) | zero or more usr blks | hdr(8:a) |
+ * | seglen | hdr(16:a)| ftr(16:a)| zero or more usr blks | hdr(0:a) |
  *  -----------------------------------------------------------------
  *          |       prologue      |                       | epilogue |
  *          |         block       |                       | block    |
  *
  * The allocated prologue and epilogue blocks are overhead that
- * eliminate edge conditions during coalescing.
+ * eliminate edge conditions during coalescing. The padding word holds
+ * the segment's length, so segments can be walked without their blocks.
+ * Block sizes are multiples of DSIZE and segments start on a page, so
+ * every payload is 16-byte aligned.
+ *
+ * Each thread allocates from one of NARENAS arenas, and each arena owns
+ * its own segments, free lists and lock. Segments are whole pages and
+ * page_arena[] records the owner of every heap page, so mm_free and
+ * mm_realloc can find a block's arena from its address alone, even when
+ * it is freed by another thread. An arena whose newest segment still
+ * ends at the brk grows that segment in place; otherwise it starts a
+ * new segment at the brk. Symmetrically, when a free block of more than
+ * TRIM_THRESHOLD bytes ends the heap, all but TRIM_KEEP bytes of it are
+ * handed back to memlib with a negative sbrk.
+ *
+ * How much an arena grows on a miss is up to its growth policy. Each
+ * arena has a chunk size, between GROW_MIN and GROW_MAX. If the arena
+ * misses again before freeing a chunk's worth of blocks, it is under
+ * sustained pressure: it grows by the chunk, which then doubles. If it
+ * has freed that much, the chunk halves, and the arena grows by
+ * exactly the shortfall when its last block is free and can grow in
+ * place, or by the chunk otherwise. A free last block always counts
+ * toward the growth. mm_growstats counts how often each path was taken.
+ *
+ * Free blocks are kept on doubly linked lists threaded through their
+ * payload (pred pointer in the first word, succ pointer in the second).
+ * Every free size falls into exactly one class (fl, sl): the first
+ * level fl is the position of the size's most significant bit, and the
+ * second level sl splits each power-of-two range into SL_COUNT equal
+ * slices. Sizes below SMALL_BLOCK are split linearly instead. One bit
+ * per class in fl_bitmap/sl_bitmap records which lists are non-empty,
+ * so finding a class that is guaranteed to fit takes two find-first-set
+ * instructions, and inserting or removing a block is a constant number
+ * of pointer updates.
+ *
+ * Free blocks of LARGE_BLOCK bytes or more are not on a class list but
+ * in a red-black tree per arena, ordered by size and then by address,
+ * with the left, right and parent links and the color threaded through
+ * the payload. A lookup takes the smallest block that fits, and the
+ * lowest addressed one among equals, in O(log n): large blocks are few
+ * but expensive to fragment, so they get a true best fit.
+ *
+ * Requests of SLAB_MAX bytes or less never get a block of their own.
+ * They are served from slabs: allocated blocks of exactly PAGESIZE
+ * bytes whose payload starts on a page, so that back to back slabs fill
+ * whole pages. Each is cut into equal objects of one size class with no
+ * per object header. A slab starts with a slab_t holding a bitmap of its
+ * free objects, and its page is marked SLAB_PAGE in page_arena[], which
+ * is how mm_free tells an object from a block. Each arena keeps a list
+ * per class of the slabs that have free objects, and a slab that
+ * empties goes back to the heap as an ordinary free block unless it is
+ * the last one on its list.
+ *
+ * Blocks that mm_malloc_hint is told are short-lived, of up to
+ * NURSERY_MAX bytes, are kept out of the heap's long-lived blocks: each
+ * arena bump allocates them from a nursery, an allocated block of
+ * NURSERY_SIZE bytes aligned on its size, whose pages are marked
+ * NURSERY_PAGE. A nursery_t at its start counts the live objects, each
+ * of which has a header like a block's. When the current nursery is
+ * full a new one replaces it, and the old one is retired until its last
+ * object is freed: then it becomes the arena's spare nursery, if it has
+ * none, or goes back to the heap as a whole. The current one just
+ * starts over. A short-lived block that outlives the others pins its
+ * whole nursery, so the hint is only worth giving when it is right.
+ *
+ * For mm_calloc, each arena keeps a zero mark in its top segment: every
+ * byte from the mark up to the footer of the segment's last block is
+ * zero. Memory that memlib hands out fresh moves the mark down, and
+ * placing a block past it moves it up beyond the block and the links
+ * of the free remainder. A calloc'd block is then only cleared below
+ * the mark.
  */
 #include <stdio.h>
 #include <unistd.h>
 #include <string.h>
 #include <stdlib.h>
+#include <pthread.h>
 #include "mm.h"
 #include "memlib.h"
+#include "config.h"
 
 /*
- * If NEXT_FIT defined use next fit search, else use first fit search
+ * Placement policies, chosen at compile time (e.g. -DFIT=FIT_BEST):
+ *
+ * FIT       which free block find_fit takes for a request
+ *   FIT_GOOD    the head of its class, or of the first class above
+ *               whose blocks all fit (the default)
+ *   FIT_FIRST   the first that fits in its class list, else as above
+ *   FIT_BEST    the smallest that fits
+ *   FIT_NEXT    the next that fits after the last one taken, walking
+ *               the arena's blocks rather than the class lists
+ * INSERT    where a freed block goes in its class list
+ *   INSERT_LIFO the front (the default), INSERT_FIFO the back,
+ *   INSERT_ADDR address order
+ * SPLIT_MIN the smallest remainder split off a block as a free block
+ *           of its own; anything smaller stays with the block
+ *
+ * Large blocks always get the tree's best fit, in size-address order.
  */
-#define NEXT_FITx
+#define FIT_GOOD     0
+#define FIT_FIRST    1
+#define FIT_BEST     2
+#define FIT_NEXT     3
+#define INSERT_LIFO  0
+#define INSERT_FIFO  1
+#define INSERT_ADDR  2
+
+#ifndef FIT
+#define FIT  FIT_GOOD
+#endif
+#ifndef INSERT
+#define INSERT  INSERT_LIFO
+#endif
 
 /* Team structure */
 team_t team = {
-#ifdef NEXT_FIT
+#if FIT == FIT_NEXT
     "implicit next fit",
 #else
-    "explicit first fit",
+    "segregated fit",
 #endif
     "Sam Hopkins", "h0pkins3",
     "Annie Larkin", "avl7949"
@@ -48,155 +152,607 @@ team_t team = {
 
 /* $begin mallocmacros */
 /* Basic constants and macros */
-#define WSIZE       4       /* word size (bytes) */
-#define DSIZE       8       /* doubleword size (bytes) */
+#define WSIZE       8       /* word size (bytes) */
+#define DSIZE       16      /* doubleword size (bytes) */
 #define CHUNKSIZE  (1<<14)  /* initial heap size (bytes) */
-#define OVERHEAD    8       /* overhead of header and footer (bytes) */
+#define OVERHEAD    WSIZE   /* overhead of an allocated block: header only */
+#define MIN_BLOCK  (2*DSIZE) /* header, pred, succ and footer of a free block */
+
+#ifndef SPLIT_MIN
+#define SPLIT_MIN  MIN_BLOCK
+#elif SPLIT_MIN < MIN_BLOCK || SPLIT_MIN % DSIZE
+#error "SPLIT_MIN must be a multiple of DSIZE, and at least MIN_BLOCK"
+#endif
 
 #define MAX(x, y) ((x) > (y)? (x) : (y))
+#define MIN(x, y) ((x) < (y)? (x) : (y))
 
 /* Pack a size and allocated bit into a word */
 #define PACK(size, alloc)  ((size) | (alloc))
+#define PREV_ALLOC  0x2     /* header bit: previous block is allocated */
+#define CHECK_MARK  0x4     /* header bit: mm_checkheap found the block listed */
 
 /* Read and write a word at address p */
 #define GET(p)       (*(size_t *)(p))
 #define PUT(p, val)  (*(size_t *)(p) = (val))
 
+/* Read and write a free list link at address p */
+#define GET_PTR(p)       (*(char **)(p))
+#define PUT_PTR(p, ptr)  (*(char **)(p) = (char *)(ptr))
+
 /* Read the size and allocated fields from address p */
 #define GET_SIZE(p)  (GET(p) & ~0x7)
 #define GET_ALLOC(p) (GET(p) & 0x1)
+#define GET_PREV_ALLOC(p) (GET(p) & PREV_ALLOC)
+
+/* Set or clear the prev-alloc bit of the header at address p */
+#define SET_PREV_ALLOC(p)  PUT(p, GET(p) | PREV_ALLOC)
+#define CLR_PREV_ALLOC(p)  PUT(p, GET(p) & ~PREV_ALLOC)
 
 /* Given block ptr bp, compute address of its header and footer */
 #define HDRP(bp)       ((char *)(bp) - WSIZE)
 #define FTRP(bp)       ((char *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)
-#define NEXT_PTR(bp)       ((char *)(bp + WSIZE))
-#define PREV_PTR(bp)       ((char *)(bp))
 
+/* Given free block ptr bp, compute address of its pred and succ links */
+#define PREV_PTR(bp)   ((char *)(bp))
+#define NEXT_PTR(bp)   ((char *)(bp) + WSIZE)
+
+/* Given large free block ptr bp, compute address of its tree fields */
+#define LEFT_PTR(bp)   ((char *)(bp))
+#define RIGHT_PTR(bp)  ((char *)(bp) + WSIZE)
+#define PARENT_PTR(bp) ((char *)(bp) + 2*WSIZE)
+#define COLOR_PTR(bp)  ((char *)(bp) + 3*WSIZE)
+#define FREE_LINKS     (4*WSIZE)   /* most payload bytes a free block's links use */
 
-/* Given block ptr bp, compute address of next and previous blocks */
+/* Given block ptr bp, compute address of next and previous blocks
+   (PREV_BLKP reads the previous footer, so it is only valid when the
+   previous block is free) */
 #define NEXT_BLKP(bp)  ((char *)(bp) + GET_SIZE(((char *)(bp) - WSIZE)))
 #define PREV_BLKP(bp)  ((char *)(bp) - GET_SIZE(((char *)(bp) - DSIZE)))
 /* $end mallocmacros */
 
-/* Global variables */
-static char *heap_listp;  /* pointer to first block */
-#ifdef NEXT_FIT
-static char *rover;       /* next fit rover */
+/* $begin tlsfmacros */
+/* Size class parameters for the segregated free lists */
+#define ALIGN_SHIFT  4                         /* log2(DSIZE) */
+#define SL_SHIFT     4                         /* log2(SL_COUNT) */
+#define SL_COUNT     (1 << SL_SHIFT)           /* second-level classes */
+#define FL_SHIFT     (SL_SHIFT + ALIGN_SHIFT)  /* first log-spaced level */
+#define LARGE_SHIFT  10                        /* log2 of smallest tree block */
+#define FL_COUNT     (LARGE_SHIFT - FL_SHIFT + 1) /* first-level classes */
+#define SMALL_BLOCK  (1 << FL_SHIFT)           /* linear classes below */
+#define LARGE_BLOCK  (1 << LARGE_SHIFT)        /* tree instead of lists */
+
+/* Index of the most significant set bit of a nonzero size */
+#define FLS(x)  ((int)(8 * sizeof(unsigned long) - 1) - __builtin_clzl(x))
+
+/* Index of the least significant set bit of a nonzero bitmap */
+#define FFS(x)  (__builtin_ffs(x) - 1)
+/* $end tlsfmacros */
+
+/* $begin treemacros */
+/* Node colors of the large block tree */
+#define BLACK  0
+#define RED    1
+
+/* Read the links and color of tree node bp (NULL children are black) */
+#define LEFT(bp)    GET_PTR(LEFT_PTR(bp))
+#define RIGHT(bp)   GET_PTR(RIGHT_PTR(bp))
+#define PARENT(bp)  GET_PTR(PARENT_PTR(bp))
+#define IS_RED(bp)  ((bp) != NULL && GET(COLOR_PTR(bp)) == RED)
+#define SET_COLOR(bp, c)  PUT(COLOR_PTR(bp), (c))
+
+/* Tree order: by size, then by address */
+#define TREE_LESS(x, y)  (GET_SIZE(HDRP(x)) < GET_SIZE(HDRP(y)) || \
+			  (GET_SIZE(HDRP(x)) == GET_SIZE(HDRP(y)) && (x) < (y)))
+/* $end treemacros */
+
+/* $begin arenamacros */
+/* Arena and segment parameters */
+#define NARENAS     8                          /* threads share arenas mod NARENAS */
+#define PAGE_SHIFT  12                         /* log2 of segment granularity */
+#define PAGESIZE    (1 << PAGE_SHIFT)
+#define PAGE_ROUND(n)  (((n) + PAGESIZE-1) & ~(size_t)(PAGESIZE-1))
+#define TRIM_THRESHOLD (1<<20)                 /* free top block worth trimming */
+#define TRIM_KEEP      (TRIM_THRESHOLD/2)      /* bytes a trim leaves behind */
+#define GROW_MIN       PAGESIZE                /* smallest chunk an arena grows by */
+#define GROW_MAX       (1<<16)                 /* largest chunk */
+
+/* Index into page_arena[] of the heap page holding address p */
+#define PAGE_INDEX(p)  ((size_t)((char *)(p) - (char *)mem_heap_lo()) >> PAGE_SHIFT)
+
+/* page_arena[] entries: owning arena, and whether the page is a slab
+   or part of a nursery */
+#define ARENA_MASK    0x3f
+#define NURSERY_PAGE  0x40
+#define SLAB_PAGE     0x80
+
+/* Given segment ptr seg, compute its first block and the next segment */
+#define SEG_FIRST(seg) ((char *)(seg) + 2*DSIZE)
+#define NEXT_SEG(seg)  ((char *)(seg) + GET(seg))
+/* $end arenamacros */
+
+/* $begin slabmacros */
+/* Slab parameters: objects of DSIZE, 2*DSIZE, ... SLAB_MAX bytes */
+#define SLAB_MAX      64
+#define SLAB_CLASSES  (SLAB_MAX / DSIZE)
+#define SLAB_WORDS    (PAGESIZE / DSIZE / 32)   /* bitmap words per slab */
+
+/* Class of a small request, and the object size of class cls */
+#define SLAB_CLASS(size)  (((size) + DSIZE-1) / DSIZE - 1)
+#define SLAB_OSIZE(cls)   (((cls) + 1) * DSIZE)
+
+/* Offset of the first object in a slab, and objects per slab of class cls */
+#define SLAB_FIRST     ((sizeof(slab_t) + DSIZE-1) & ~(size_t)(DSIZE-1))
+#define SLAB_CAP(cls)  ((PAGESIZE - OVERHEAD - SLAB_FIRST) / SLAB_OSIZE(cls))
+
+/* Given object ptr p, compute the slab (page start) that holds it */
+#define SLAB_OF(p)  ((slab_t *)((char *)mem_heap_lo() + (PAGE_INDEX(p) << PAGE_SHIFT)))
+/* $end slabmacros */
+
+/* $begin nurserymacros */
+/* Nursery parameters: short-lived blocks of up to NURSERY_MAX bytes */
+#define NURSERY_SIZE   PAGESIZE
+#define NURSERY_MAX    256
+#define NURSERY_FIRST  (2*DSIZE)   /* payload of the first object */
+
+/* Given object ptr p, compute the nursery that holds it */
+#define NURSERY_OF(p)  ((nursery_t *)((size_t)(p) & ~(size_t)(NURSERY_SIZE-1)))
+/* $end nurserymacros */
+
+/* Head of a nursery */
+typedef struct {
+    char *bump;                           /* payload of the next object */
+    size_t live;                          /* objects not yet freed */
+} nursery_t;
+
+/* Head of a slab page */
+typedef struct slab {
+    struct slab *next, *prev;             /* arena's list for this class */
+    unsigned short cls;                   /* size class of the objects */
+    unsigned short nfree;                 /* free objects left */
+    unsigned int map[SLAB_WORDS];         /* bit set: object is free */
+} slab_t;
+
+/* An independent heap: its own segments, class lists and lock */
+typedef struct {
+    pthread_mutex_t lock;                 /* held across every operation */
+    char *top_seg;                        /* newest segment */
+    char *top;                            /* epilogue header of top_seg */
+    char *zero;                           /* top_seg is zero from here to
+					     its last footer */
+#if FIT == FIT_NEXT
+    char *rover;                          /* next fit rover */
+#endif
+    /* Segregated free list heads and the bitmaps that index them */
+    unsigned int fl_bitmap;               /* bit f: sl_bitmap[f] != 0 */
+    unsigned int sl_bitmap[FL_COUNT];     /* bit s: list (f,s) nonempty */
+    char *free_lists[FL_COUNT][SL_COUNT]; /* list heads */
+#if INSERT == INSERT_FIFO
+    char *free_tails[FL_COUNT][SL_COUNT]; /* list tails */
 #endif
+    char *tree_root;                      /* free blocks >= LARGE_BLOCK */
+    slab_t *slabs[SLAB_CLASSES];          /* slabs with free objects */
+    nursery_t *nursery;                   /* where short-lived blocks go */
+    nursery_t *spare;                     /* an empty one, kept for reuse */
+
+    /* Growth policy state and counters */
+    size_t chunk;                         /* bytes the next miss grows by */
+    size_t freed;                         /* bytes freed since the last growth */
+    size_t grow_exact, grow_doubled, grow_halved; /* misses by path */
+} arena_t;
+
+/* Note that a block ends at bp, so a's heap below bp's links may hold data */
+#define DIRTY_TO(a, bp)  ((a)->zero = MAX((a)->zero, (char *)(bp) + FREE_LINKS))
+
+/* Report a heap inconsistency found by mm_checkheap */
+#define CHECK_ERROR(...)  (check_errors++, printf(__VA_ARGS__))
+
+/* Global variables */
+static arena_t arenas[NARENAS];
+static unsigned char page_arena[MAX_HEAP >> PAGE_SHIFT]; /* owner of each page */
+static pthread_mutex_t grow_lock = PTHREAD_MUTEX_INITIALIZER; /* guards the brk */
+static int next_arena;                    /* round-robin arena assignment */
+static __thread int my_arena = -1;        /* this thread's arena, once assigned */
+static int check_errors;                  /* errors found by mm_checkheap */
 
 
 /* function prototypes for internal helper routines */
-static void *extend_heap(size_t words);
-static void place(void *bp, size_t asize);
-static void *find_fit(size_t asize);
-static void *coalesce(void *bp);
+static arena_t *thread_arena(void);
+static arena_t *arena_of(void *bp);
+static void *extend_heap(arena_t *a, size_t size);
+static void *grow_heap(arena_t *a, size_t asize);
+static void place(arena_t *a, void *bp, size_t asize);
+static void place_split(arena_t *a, void *bp, size_t asize, size_t split);
+static size_t place_batch(arena_t *a, char *bp, size_t asize, size_t n, void **out);
+static void free_block(arena_t *a, void *bp);
+static void trim_top(arena_t *a, char *bp);
+static void *place_aligned(arena_t *a, size_t align, size_t asize);
+static void *slab_alloc(arena_t *a, int cls);
+static void slab_free(arena_t *a, void *p);
+static void slab_unlink(arena_t *a, slab_t *s);
+static void *nursery_alloc(arena_t *a, size_t size);
+static void nursery_free(arena_t *a, void *p);
+static void *find_fit(arena_t *a, size_t asize);
+#if FIT == FIT_FIRST || FIT == FIT_BEST
+static void *list_fit(char *bp, size_t asize);
+#endif
+#if FIT != FIT_NEXT
+static int class_search(arena_t *a, size_t asize, int *fl, int *sl);
+static void mapping_search(size_t size, int *fl, int *sl);
+static void *tree_search(arena_t *a, size_t asize);
+#endif
+static void *coalesce(arena_t *a, void *bp);
+static size_t adjust_size(size_t size);
+static void shrink_block(arena_t *a, void *bp, size_t asize);
+static void mapping_insert(size_t size, int *fl, int *sl);
+static void insert_free_block(arena_t *a, void *bp);
+static void remove_free_block(arena_t *a, void *bp);
+static void tree_insert(arena_t *a, char *bp);
+static void tree_remove(arena_t *a, char *z);
+static void tree_insert_fixup(arena_t *a, char *x);
+static void tree_remove_fixup(arena_t *a, char *x, char *xp);
+static void tree_replace(arena_t *a, char *u, char *v);
+static void rotate_left(arena_t *a, char *x);
+static void rotate_right(arena_t *a, char *x);
+static int checktree(arena_t *a, char *bp, char *parent, char **prev, int *count);
+static int checkmark(arena_t *a, char *bp);
+static void print_tree(char *bp);
+#if FIT == FIT_NEXT
+static char *next_arena_block(arena_t *a, char *bp);
+#endif
 static void printblock(void *bp);
 static void checkblock(void *bp);
-
-/* My Global variables */
-char *root = NULL;
-char *end;
-int free_list_size = 0;
+static void checkslab(slab_t *s);
+static void checknursery(arena_t *a, nursery_t *n);
+int mm_checkheap(int verbose);
+void mm_freestats(size_t *count, size_t *largest);
+void mm_growstats(size_t *exact, size_t *doubled, size_t *halved);
+void mm_lock_all(void);
+void mm_unlock_all(void);
+void print_free_list(void);
 
 
 /*
  * mm_init - Initialize the memory manager
  */
 /* $begin mminit */
-int mm_init(void)                     //DONE
+int mm_init(void)
 {
-    /* create the initial empty heap */
-    if ((heap_listp = mem_sbrk(16)) == NULL)
-	return -1;
-    PUT(heap_listp, 0);                        /* alignment padding */
-    PUT(heap_listp+WSIZE, PACK(OVERHEAD, 1));  /* prologue header */
-    PUT(heap_listp+DSIZE, PACK(OVERHEAD, 1));  /* prologue footer */
-    PUT(heap_listp+WSIZE+DSIZE, PACK(0, 1));   /* epilogue header */
-    heap_listp += DSIZE;
-    end = heap_listp + WSIZE + DSIZE;       //initialize end, which points to the epilogue block
-    root = NULL;
-    free_list_size = 0;
-
-#ifdef NEXT_FIT
-    rover = heap_listp;
-#endif
+    int i;
+
+    /* every arena starts out with no segments and empty class lists */
+    for (i = 0; i < NARENAS; i++) {
+	memset(&arenas[i], 0, sizeof(arena_t));
+	pthread_mutex_init(&arenas[i].lock, NULL);
+	arenas[i].chunk = GROW_MIN;
+    }
+    memset(page_arena, 0, sizeof(page_arena));
 
-    /* Extend the empty heap with a free block of CHUNKSIZE bytes */
-    if (extend_heap(CHUNKSIZE/WSIZE) == NULL)
+    /* Give the caller's arena a first segment with CHUNKSIZE free bytes */
+    if (extend_heap(thread_arena(), CHUNKSIZE) == NULL)
 	return -1;
     return 0;
 }
 /* $end mminit */
 
-/* root
+/*
  * mm_malloc - Allocate a block with at least size bytes of payload
  */
 /* $begin mmmalloc */
-void *mm_malloc(size_t size)          //DONE
+void *mm_malloc(size_t size)
 {
-  //printf("In malloc\n");
-
     size_t asize;      /* adjusted block size */
     char *bp;
+    arena_t *a;
 
-    // mm_checkheap(1);
     /* Ignore spurious requests */
     if (size <= 0)
 	     return NULL;
 
+    a = thread_arena();
+    pthread_mutex_lock(&a->lock);
+
+    /* Small objects come from a slab */
+    if (size <= SLAB_MAX) {
+	bp = slab_alloc(a, SLAB_CLASS(size));
+	pthread_mutex_unlock(&a->lock);
+	return bp;
+    }
+
     /* Adjust block size to include overhead and alignment reqs. */
-    if (size <= DSIZE){
-	    asize = DSIZE + OVERHEAD;
+    asize = adjust_size(size);
+
+    if ((bp = find_fit(a, asize)) == NULL) {
+	/* No fit found. Get more memory and place the block  */
+	if ((bp = grow_heap(a, asize)) == NULL){
+	    pthread_mutex_unlock(&a->lock);
+	    return NULL;
+	}
     }
-    else {
-	    asize = DSIZE * ((size + (OVERHEAD) + (DSIZE-1)) / DSIZE);
+    place(a, bp, asize);
+    pthread_mutex_unlock(&a->lock);
+    return bp;
+}
+/* $end mmmalloc */
+
+/*
+ * mm_malloc_hint - mm_malloc for a block that the caller expects to
+ *     live as long as lifetime says, MM_SHORT_LIVED or MM_LONG_LIVED.
+ *     Small short-lived blocks come from the arena's nursery.
+ */
+void *mm_malloc_hint(size_t size, int lifetime)
+{
+    char *bp;
+    arena_t *a;
+
+    if (lifetime != MM_SHORT_LIVED || size == 0 || size > NURSERY_MAX)
+	return mm_malloc(size);
+
+    a = thread_arena();
+    pthread_mutex_lock(&a->lock);
+    bp = nursery_alloc(a, size);
+    pthread_mutex_unlock(&a->lock);
+    return bp;
+}
+
+/*
+ * mm_calloc - Allocate a zero-filled array of nmemb elements of size
+ *     bytes each. Only the part of the block below its arena's zero
+ *     mark is cleared; memory fresh from memlib is zero already.
+ */
+void *mm_calloc(size_t nmemb, size_t size)
+{
+    size_t bytes, asize;
+    char *bp, *zero, *ftr;
+    arena_t *a;
+
+    if (nmemb == 0 || size == 0 || nmemb > (size_t)-1 / size)
+	return NULL;
+    bytes = nmemb * size;
+
+    if (bytes <= SLAB_MAX) {
+	if ((bp = mm_malloc(bytes)) != NULL)
+	    memset(bp, 0, bytes);
+	return bp;
     }
 
-    if ((bp = find_fit(asize)) != NULL) {
-	    place(bp, asize);
-	    return bp;
+    asize = adjust_size(bytes);
+    a = thread_arena();
+    pthread_mutex_lock(&a->lock);
+    if ((bp = find_fit(a, asize)) == NULL &&
+	(bp = grow_heap(a, asize)) == NULL) {
+	pthread_mutex_unlock(&a->lock);
+	return NULL;
     }
-    /* No fit found. Get more memory and place the block  */
-    if ((bp = extend_heap(CHUNKSIZE)) == NULL){
-	    return NULL;
+    zero = a->zero;               /* placing bp moves the mark past it */
+    ftr = FTRP(bp);               /* not zero, and payload if bp is not split */
+    place(a, bp, asize);
+    pthread_mutex_unlock(&a->lock);
+
+    if (bp < zero)
+	memset(bp, 0, MIN(bytes, (size_t)(zero - bp)));
+    if (ftr >= zero && ftr < bp + bytes)
+	PUT(ftr, 0);
+    return bp;
+}
+
+/*
+ * mm_malloc_batch - Allocate n blocks with at least size bytes of
+ *     payload each, storing them in out. As many blocks as fit are
+ *     carved back to back from each free region found, so a batch
+ *     takes one search and one split per region instead of one per
+ *     block. A region is looked for, or grown, for up to GROW_MAX
+ *     bytes of the batch at a time. Returns the number allocated, less
+ *     than n only when the heap is exhausted.
+ */
+size_t mm_malloc_batch(size_t size, size_t n, void **out)
+{
+    size_t asize, want, i = 0;
+    char *bp;
+    arena_t *a;
+
+    if (size <= 0 || n == 0)
+	return 0;
+    asize = adjust_size(size);
+    if (n > (size_t)-1 / asize)       /* the batch's bytes overflow */
+	return 0;
+
+    a = thread_arena();
+    pthread_mutex_lock(&a->lock);
+
+    /* Small objects come from slabs, under a single lock */
+    if (size <= SLAB_MAX) {
+	while (i < n && (out[i] = slab_alloc(a, SLAB_CLASS(size))) != NULL)
+	    i++;
+	pthread_mutex_unlock(&a->lock);
+	return i;
+    }
+
+    /* Find room for the rest of the batch, or failing that for one block */
+    while (i < n) {
+	want = MIN((n-i) * asize, MAX(GROW_MAX, asize));
+	if ((bp = find_fit(a, want)) == NULL &&
+	    (bp = grow_heap(a, want)) == NULL &&
+	    (bp = find_fit(a, asize)) == NULL &&
+	    (bp = grow_heap(a, asize)) == NULL)
+	    break;
+	i += place_batch(a, bp, asize, n-i, out+i);
     }
-    place(bp, asize);
+    pthread_mutex_unlock(&a->lock);
+    return i;
+}
+
+/*
+ * mm_memalign - Allocate a block with at least size bytes of payload
+ *     starting on an alignment boundary. alignment must be a power of
+ *     two; ALIGNMENT or less is what mm_malloc gives anyway.
+ */
+void *mm_memalign(size_t alignment, size_t size)
+{
+    char *bp;
+    arena_t *a;
+
+    if (size == 0 || alignment == 0 || (alignment & (alignment-1)))
+	return NULL;
+    if (alignment <= ALIGNMENT)
+	return mm_malloc(size);
+
+    a = thread_arena();
+    pthread_mutex_lock(&a->lock);
+    bp = place_aligned(a, alignment, adjust_size(size));
+    pthread_mutex_unlock(&a->lock);
     return bp;
 }
-/* $end mmmalloc */
 
 /*
  * mm_free - Free a block
  */
 /* $begin mmfree */
-void mm_free(void *bp)                  //DONE
+void mm_free(void *bp)
 {
-  //printf("In free \n");
-
-    size_t size = GET_SIZE(HDRP(bp));
+    arena_t *a = arena_of(bp);        //the owner, not necessarily ours
+
+    pthread_mutex_lock(&a->lock);
+    if (page_arena[PAGE_INDEX(bp)] & SLAB_PAGE)
+	slab_free(a, bp);             //an object, not a block
+    else if (page_arena[PAGE_INDEX(bp)] & NURSERY_PAGE)
+	nursery_free(a, bp);
+    else
+	free_block(a, bp);
+    pthread_mutex_unlock(&a->lock);
+}
 
-    PUT(HDRP(bp), PACK(size, 0));
-    PUT(FTRP(bp), PACK(size, 0));     //set the header and footer to 0
+/* $end mmfree */
 
-    coalesce(bp);       //check if needs coalescing
+/*
+ * mm_free_batch - Free the n blocks in ptrs. Consecutive entries that
+ *     are also neighbors in the heap, as the blocks of one
+ *     mm_malloc_batch are, become a single free block before
+ *     coalescing, so each such run costs one class list update.
+ */
+void mm_free_batch(void **ptrs, size_t n)
+{
+    size_t i, j, size;
+    char *bp;
+    arena_t *a;
+
+    for (i = 0; i < n; i = j) {
+	bp = ptrs[i];
+	a = arena_of(bp);
+	pthread_mutex_lock(&a->lock);
+	if (page_arena[PAGE_INDEX(bp)] & (SLAB_PAGE | NURSERY_PAGE)) {
+	    if (page_arena[PAGE_INDEX(bp)] & SLAB_PAGE)
+		slab_free(a, bp);
+	    else
+		nursery_free(a, bp);
+	    j = i + 1;
+	}
+	else {
+	    size = GET_SIZE(HDRP(bp));
+	    for (j = i + 1; j < n && (char *)ptrs[j] == bp + size; j++)
+		size += GET_SIZE(HDRP(ptrs[j]));
+	    PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp)) | 1));
+	    free_block(a, bp);
+	}
+	pthread_mutex_unlock(&a->lock);
+    }
 }
 
-/* $end mmfree */
+/*
+ * mm_usable_size - Return how many payload bytes ptr can hold, which
+ *     may be more than were asked for. Only the owner of an allocated
+ *     block changes its size, so no lock is needed.
+ */
+size_t mm_usable_size(void *ptr)
+{
+    if (page_arena[PAGE_INDEX(ptr)] & SLAB_PAGE)
+	return SLAB_OSIZE(SLAB_OF(ptr)->cls);
+    return GET_SIZE(HDRP(ptr)) - OVERHEAD;
+}
 
 /*
- * mm_realloc - naive implementation of mm_realloc
+ * mm_realloc - Resize a block, in place whenever the neighborhood allows
+ *
+ * Shrinking splits the tail off as a free block. Growing first absorbs
+ * a free successor, and a block at the top of its arena (possibly behind
+ * one trailing free block) grows by sbrk'ing just the shortfall. Only
+ * when neither works is the payload copied to a fresh block, which comes
+ * from the calling thread's arena. A slab or nursery object stays put
+ * as long as the new size fits it. If there is no room anywhere, NULL
+ * is returned and ptr is left as it was, as realloc(3) requires.
  */
 void *mm_realloc(void *ptr, size_t size)
 {
     void *newp;
-    size_t copySize;
-   // //printf("In REALLOC \n");
+    char *next;
+    size_t asize, oldsize, copySize;
+    arena_t *a;
+
+    if (ptr == NULL)
+	return mm_malloc(size);
+    if (size == 0) {
+	mm_free(ptr);
+	return NULL;
+    }
 
-    if ((newp = mm_malloc(size)) == NULL) {
-	printf("ERROR: mm_malloc failed in mm_realloc\n");
-	exit(1);
+    /* Slab and nursery objects can only be resized within their size */
+    if (page_arena[PAGE_INDEX(ptr)] & (SLAB_PAGE | NURSERY_PAGE)) {
+	oldsize = mm_usable_size(ptr);
+	if (size <= oldsize)
+	    return ptr;
+	if ((newp = mm_malloc(size)) == NULL)
+	    return NULL;
+	memcpy(newp, ptr, oldsize);
+	mm_free(ptr);
+	return newp;
     }
-    copySize = GET_SIZE(HDRP(ptr));
+
+    asize = adjust_size(size);
+    a = arena_of(ptr);
+    pthread_mutex_lock(&a->lock);
+    oldsize = GET_SIZE(HDRP(ptr));
+
+    /* Shrinking (or same size): give back the tail */
+    if (asize <= oldsize) {
+	shrink_block(a, ptr, asize);
+	pthread_mutex_unlock(&a->lock);
+	return ptr;
+    }
+
+    /* Growing at the top of the arena: sbrk exactly what is missing */
+    next = NEXT_BLKP(ptr);
+    if (HDRP(next) == a->top ||
+	(!GET_ALLOC(HDRP(next)) && HDRP(NEXT_BLKP(next)) == a->top)) {
+	size_t have = oldsize + (GET_ALLOC(HDRP(next)) ? 0 : GET_SIZE(HDRP(next)));
+	if (have < asize &&
+	    extend_heap(a, MAX(asize - have, MIN_BLOCK)) == NULL) {
+	    pthread_mutex_unlock(&a->lock);
+	    return NULL;
+	}
+	next = NEXT_BLKP(ptr);     /* new space merged into one free block */
+    }
+
+    /* Growing into a free successor */
+    if (!GET_ALLOC(HDRP(next)) && oldsize + GET_SIZE(HDRP(next)) >= asize) {
+	remove_free_block(a, next);
+#if FIT == FIT_NEXT
+	if (a->rover == next)
+	    a->rover = ptr;
+#endif
+	oldsize += GET_SIZE(HDRP(next));
+	PUT(HDRP(ptr), PACK(oldsize, GET_PREV_ALLOC(HDRP(ptr)) | 1));
+	SET_PREV_ALLOC(HDRP(NEXT_BLKP(ptr)));
+	shrink_block(a, ptr, asize);
+	DIRTY_TO(a, NEXT_BLKP(ptr));
+	pthread_mutex_unlock(&a->lock);
+	return ptr;
+    }
+    pthread_mutex_unlock(&a->lock);
+
+    /* No room around the block: move it */
+    if ((newp = mm_malloc(size)) == NULL)
+	return NULL;
+    copySize = oldsize - OVERHEAD;
     if (size < copySize)
       copySize = size;
     memcpy(newp, ptr, copySize);
@@ -205,394 +761,1242 @@ void *mm_realloc(void *ptr, size_t size)
 }
 
 /*
- * mm_checkheap - Check the heap for consistency
+ * mm_checkheap - Check the heap for consistency. Walks every segment of
+ *     every arena, so no other thread may be using the allocator.
+ *     Runs in time linear in the number of blocks: the class lists and
+ *     trees are walked first, setting CHECK_MARK in the header of every
+ *     free block found on them, and the heap walk then checks and clears
+ *     the mark of every free block instead of searching for it. Only a
+ *     verbose check reads every byte above the zero marks. Returns the
+ *     number of errors found.
  */
-void mm_checkheap(int verbose)
+int mm_checkheap(int verbose)
 {
-    char *bp = heap_listp;
+    char *seg, *bp, *end;
+    char *list_checker;
+    int i, fl, sl;
+    arena_t *a;
+    size_t prev_alloc;     /* what the next header's pa must say */
+    int heap_free = 0;     /* free blocks found walking the heap */
+    int list_free = 0;     /* free blocks found walking the class lists */
+
+    check_errors = 0;
+    for (i = 0; i < NARENAS; i++){            //walk every class list of every arena
+      a = &arenas[i];
+      for (fl = 0; fl < FL_COUNT; fl++){
+        if (!(a->fl_bitmap & (1U << fl)) != !a->sl_bitmap[fl]){
+          CHECK_ERROR("ERROR: First-level bitmap out of sync at %d\n", fl);
+        }
+        for (sl = 0; sl < SL_COUNT; sl++){
+          char *prev = NULL;
+          int f, s;
 
-    if (verbose){
-	   printf("Heap (%p):\n", heap_listp);
-    }
+          if (!(a->sl_bitmap[fl] & (1U << sl)) != (a->free_lists[fl][sl] == NULL)){
+            CHECK_ERROR("ERROR: Second-level bitmap out of sync at (%d,%d)\n", fl, sl);
+          }
+          for (list_checker = a->free_lists[fl][sl]; list_checker != NULL;
+               list_checker = GET_PTR(NEXT_PTR(list_checker))){
+            if (!checkmark(a, list_checker))
+              break;       //can't follow this list any further
+            list_free++;
+            if (GET_ALLOC(FTRP(list_checker))){
+              CHECK_ERROR("ERROR: Allocated footer block in free list\n");   //if footer of pointer is allocated
+            }
+            if (GET_PTR(PREV_PTR(list_checker)) != prev){
+              CHECK_ERROR("ERROR: Broken pred link at %p\n", list_checker);
+            }
+            mapping_insert(GET_SIZE(HDRP(list_checker)), &f, &s);
+            if (GET_SIZE(HDRP(list_checker)) >= LARGE_BLOCK || f != fl || s != sl){
+              CHECK_ERROR("ERROR: Block %p of size %u filed under (%d,%d)\n",
+                     list_checker, (unsigned)GET_SIZE(HDRP(list_checker)), fl, sl);
+            }
+            prev = list_checker;
+          }
+        }
+      }
 
-    if ((GET_SIZE(HDRP(heap_listp)) != DSIZE) || !GET_ALLOC(HDRP(heap_listp))){ //Checks header and footer of the heap list
-	   printf("Bad prologue header\n");
-     checkblock(heap_listp);
+      /* every listed slab must have room and sit on its class's list */
+      for (fl = 0; fl < SLAB_CLASSES; fl++){
+        slab_t *s, *prev = NULL;
+
+        for (s = a->slabs[fl]; s != NULL; prev = s, s = s->next){
+          if (!(page_arena[PAGE_INDEX(s)] & SLAB_PAGE) || s->cls != fl || s->nfree == 0){
+            CHECK_ERROR("ERROR: Slab %p does not belong on class list %d\n", s, fl);
+          }
+          if (s->prev != prev){
+            CHECK_ERROR("ERROR: Broken slab prev link at %p\n", s);
+          }
+        }
+      }
+
+      /* the zero mark must not promise zeros that are not there. Reading
+         them all maps in pages never touched and costs time in the heap's
+         bytes, so unless verbose only the rest of the mark's page is read */
+      end = (a->top == NULL) ? a->zero : a->top - WSIZE;
+      if (!verbose)
+        end = MIN(end, (char *)PAGE_ROUND((size_t)a->zero));
+      for (bp = a->zero; bp < end; bp += WSIZE){
+        if (GET(bp) != 0){
+          CHECK_ERROR("ERROR: Arena %d is not zero at %p above its mark %p\n", i, bp, a->zero);
+          break;
+        }
+      }
+
+      /* the tree must be a valid red-black tree of large free blocks */
+      if (IS_RED(a->tree_root)){
+        CHECK_ERROR("ERROR: Red root in large block tree of arena %d\n", i);
+      }
+      list_checker = NULL;
+      checktree(a, a->tree_root, NULL, &list_checker, &list_free);
     }
 
-    for (bp = heap_listp; bp != end; bp = NEXT_BLKP(bp)) { //Outputs information concerning the current malloc
+    for (seg = mem_heap_lo(); seg < (char *)mem_heap_hi(); seg = NEXT_SEG(seg)) {
+      a = arena_of(seg);
+      bp = seg + DSIZE;    //the prologue
+      if (verbose){
+	   printf("Segment (%p, %u bytes) of arena %d:\n", seg,
+		  (unsigned)GET(seg), (int)(a - arenas));
+      }
+
+      if ((GET_SIZE(HDRP(bp)) != DSIZE) || !GET_ALLOC(HDRP(bp))){ //Checks header and footer of the prologue
+	   CHECK_ERROR("Bad prologue header\n");
+	   checkblock(bp);
+      }
+
+      prev_alloc = PREV_ALLOC;
+      for (bp = SEG_FIRST(seg); GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
 	     if (verbose){
 	        printblock(bp);
-	        checkblock(bp);
         }
-    }
+        checkblock(bp);
+        if ((page_arena[PAGE_INDEX(bp)] & ARENA_MASK) != a - arenas){
+          CHECK_ERROR("ERROR: Block %p lies on a page of another arena\n", bp);
+        }
+        if (GET_PREV_ALLOC(HDRP(bp)) != prev_alloc){
+          CHECK_ERROR("ERROR: Block %p has a stale prev-alloc bit\n", bp);
+        }
+        prev_alloc = GET_ALLOC(HDRP(bp)) ? PREV_ALLOC : 0;
+        if (GET_ALLOC(HDRP(bp))){
+          if (page_arena[PAGE_INDEX(bp)] & SLAB_PAGE)
+            checkslab((slab_t *)bp);
+          else if (page_arena[PAGE_INDEX(bp)] & NURSERY_PAGE)
+            checknursery(a, (nursery_t *)bp);
+          continue;
+        }
+        heap_free++;
+        if (!GET_ALLOC(HDRP(NEXT_BLKP(bp)))){
+          CHECK_ERROR("ERROR: Coalesce failure, next block is also free\n");
+        }
 
-    char* list_checker = root;                //list checker iterates through the free list
-    for (int i = 0; i < free_list_size; i++){
-      if (GET_ALLOC(HDRP(list_checker))){
-        printf("ERROR: Allocated header block in free list\n");   //if header of pointer is allocated
+        /* every free block must have been marked on its arena's lists or tree */
+        if (!(GET(HDRP(bp)) & CHECK_MARK)){
+          CHECK_ERROR("ERROR: Free block %p of size %u missing from %s\n", bp,
+                 (unsigned)GET_SIZE(HDRP(bp)),
+                 GET_SIZE(HDRP(bp)) >= LARGE_BLOCK ? "large block tree" : "class lists");
+        }
+        PUT(HDRP(bp), GET(HDRP(bp)) & ~CHECK_MARK);
+      }
+
+      if (verbose){
+	    printblock(bp);
       }
-      else if (GET_ALLOC(FTRP(list_checker))){
-        printf("ERROR: Allocated footer block in free list\n");   //if footer of pointer is allocated
+      if ((GET_SIZE(HDRP(bp)) != 0) || !(GET_ALLOC(HDRP(bp)))){     //bad epilogue header
+	     CHECK_ERROR("Bad epilogue header\n");
       }
-      else if (!GET_ALLOC(HDRP(NEXT_BLKP(list_checker)))){
-        printf("ERROR: Coalesce failure, next block is also free");   // if the next block is free, it is not coalesced
+      if (HDRP(bp) != NEXT_SEG(seg) - WSIZE){
+        CHECK_ERROR("ERROR: Epilogue %p does not end segment %p\n", HDRP(bp), seg);
+        break;
       }
-      else if (GET_ALLOC(HDRP(PREV_BLKP(list_checker)))){
-        printf("ERROR: Coalesce failure, previous block is also free\n");   //if the previous block is free, it is not coalesced
+      if (GET_PREV_ALLOC(HDRP(bp)) != prev_alloc){
+        CHECK_ERROR("ERROR: Epilogue has a stale prev-alloc bit\n");
       }
-      list_checker = GET(NEXT_PTR(list_checker));
     }
 
-    if (free_list_size != 0){
-      for (bp = heap_listp; bp != end; bp = NEXT_BLKP(bp)){ // this double for loop checks to make sure that
-        list_checker = root;
-        int valid = 0;                                      // the free list points to all valid pointers on the heap
-          for (int i = 0; i < free_list_size; i++){
-            if (list_checker == bp){
-              valid = 1;
-            }
-            list_checker = GET(NEXT_PTR(list_checker));
-          }
-          if (!valid){
-            printf("ERROR: Invalid block in free list");        //free list contains an invalid block
-          }
-      }
-  }
+    if (heap_free != list_free){
+      CHECK_ERROR("ERROR: %d free blocks in heap but %d in class lists\n", heap_free, list_free);
+    }
 
     if (verbose){
-	    printblock(bp);
-      print_free_list(root);
+      print_free_list();
     }
+    return check_errors;
+}
 
-    if ((GET_SIZE(HDRP(bp)) != 0) || !(GET_ALLOC(HDRP(bp)))){     //bad epilogue header
-	     printf("Bad epilogue header\n");
-     }
+/*
+ * mm_freestats - Count the free blocks in the heap and find the size of
+ *     the largest. Free slab objects are not counted. Like mm_checkheap,
+ *     no other thread may be using the allocator.
+ */
+void mm_freestats(size_t *count, size_t *largest)
+{
+    char *seg, *bp;
+    size_t size;
+
+    *count = *largest = 0;
+    for (seg = mem_heap_lo(); seg < (char *)mem_heap_hi(); seg = NEXT_SEG(seg)) {
+	for (bp = SEG_FIRST(seg); (size = GET_SIZE(HDRP(bp))) > 0; bp = NEXT_BLKP(bp)) {
+	    if (GET_ALLOC(HDRP(bp)))
+		continue;
+	    (*count)++;
+	    if (size > *largest)
+		*largest = size;
+	}
+    }
 }
 
+/*
+ * mm_growstats - Count the misses that grew the heap by the shortfall
+ *     of a free last block, by a chunk that then doubled, and by one
+ *     that had just halved
+ */
+void mm_growstats(size_t *exact, size_t *doubled, size_t *halved)
+{
+    int i;
+
+    *exact = *doubled = *halved = 0;
+    for (i = 0; i < NARENAS; i++) {
+	*exact += arenas[i].grow_exact;
+	*doubled += arenas[i].grow_doubled;
+	*halved += arenas[i].grow_halved;
+    }
+}
+
+/*
+ * mm_lock_all - Take every lock of the package, and memlib's, in the
+ *     order they nest: the arenas, then grow_lock, then the brk. Around
+ *     a fork this keeps the child from inheriting a lock that a thread
+ *     which does not exist in it was holding.
+ */
+void mm_lock_all(void)
+{
+    int i;
+
+    for (i = 0; i < NARENAS; i++)
+	pthread_mutex_lock(&arenas[i].lock);
+    pthread_mutex_lock(&grow_lock);
+    mem_lock();
+}
+
+/*
+ * mm_unlock_all - Release the locks mm_lock_all took, in the parent or
+ *     in the child, where the forking thread still owns them
+ */
+void mm_unlock_all(void)
+{
+    int i;
+
+    mem_unlock();
+    pthread_mutex_unlock(&grow_lock);
+    for (i = NARENAS - 1; i >= 0; i--)
+	pthread_mutex_unlock(&arenas[i].lock);
+}
 
 
 /* The remaining routines are internal helper routines */
 
 /*
- * extend_heap - Extend heap with free block and return its block pointer
+ * thread_arena - Return the calling thread's arena, assigning one
+ *     round-robin on the thread's first call
  */
-/* $begin mmextendheap */
-static void *extend_heap(size_t words)    //DONE
+static arena_t *thread_arena(void)
 {
-    char *bp;
-    size_t size;
-    //printf("In extend heap\n");
+    if (my_arena < 0)
+	my_arena = __sync_fetch_and_add(&next_arena, 1) % NARENAS;
+    return &arenas[my_arena];
+}
+
+/*
+ * arena_of - Return the arena that owns block bp
+ */
+static arena_t *arena_of(void *bp)
+{
+    return &arenas[page_arena[PAGE_INDEX(bp)] & ARENA_MASK];
+}
 
-    /* Allocate an even number of words to maintain alignment */
-    size = (words % 2) ? (words+1) * WSIZE : words * WSIZE;
-    if ((bp = mem_sbrk(size)) == (void *)-1)
-	   return NULL;
+/*
+ * extend_heap - Extend arena a with a free block of at least size
+ *     bytes, rounded up to whole pages, and return its block pointer.
+ *     The caller holds a->lock.
+ */
+/* $begin mmextendheap */
+static void *extend_heap(arena_t *a, size_t size)
+{
+    char *bp, *seg, *fresh, *p;
+    char *old_top = NULL;     /* old epilogue, if the segment grows in place */
+
+    pthread_mutex_lock(&grow_lock);
+    fresh = mem_fresh_lo();
+    if (a->top != NULL && a->top + WSIZE == (char *)mem_heap_hi() + 1) {
+	/* our newest segment still ends at the brk: grow it in place */
+	size = PAGE_ROUND(size);
+	if ((bp = mem_sbrk(size)) == (void *)-1) {
+	    pthread_mutex_unlock(&grow_lock);
+	    return NULL;
+	}
+	PUT(a->top_seg, GET(a->top_seg) + size);
+	memset(page_arena + PAGE_INDEX(bp), a - arenas, size >> PAGE_SHIFT);
+	old_top = a->top;
+    }
+    else {
+	/* first segment, or another arena owns the brk: start a segment */
+	size = PAGE_ROUND(size + 2*DSIZE);
+	if ((seg = mem_sbrk(size)) == (void *)-1) {
+	    pthread_mutex_unlock(&grow_lock);
+	    return NULL;
+	}
+	memset(page_arena + PAGE_INDEX(seg), a - arenas, size >> PAGE_SHIFT);
+	PUT(seg, size);                             /* segment length */
+	PUT(seg+WSIZE, PACK(DSIZE, 1));             /* prologue header */
+	PUT(seg+DSIZE, PACK(DSIZE, 1));             /* prologue footer */
+	PUT(seg+WSIZE+DSIZE, PACK(0, PREV_ALLOC | 1)); /* epilogue header */
+	a->top_seg = seg;
+	bp = SEG_FIRST(seg);
+	size -= 2*DSIZE;
+#if FIT == FIT_NEXT
+	if (a->rover == NULL)
+	    a->rover = bp;
+#endif
+    }
+    a->top = bp + size - WSIZE;
+    pthread_mutex_unlock(&grow_lock);
 
     /* Initialize free block header/footer and the epilogue header */
-    PUT(HDRP(bp), PACK(size, 0));         /* free block header */
+    PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp)))); /* free block header */
     PUT(FTRP(bp), PACK(size, 0));         /* free block footer */
     PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); /* new epilogue header */
 
-    return coalesce(bp);
+    /*
+     * Fresh memory extends the zero tail of the segment. Appended to a
+     * free block, it leaves only the old footer and epilogue to clear.
+     */
+    if (old_top != NULL && !GET_PREV_ALLOC(old_top) && fresh <= bp) {
+	bp = coalesce(a, bp);
+	a->zero = MAX(MIN(a->zero, old_top - WSIZE), bp + FREE_LINKS);
+	for (p = old_top - WSIZE; p <= old_top; p += WSIZE)
+	    if (p >= a->zero)
+		PUT(p, 0);
+	return bp;
+    }
+    a->zero = MAX(fresh, bp + FREE_LINKS);
+    return coalesce(a, bp);
 }
 
 
 /* $end mmextendheap */
 
+/*
+ * grow_heap - Extend arena a by as much as its growth policy says for
+ *     a miss on an asize block, and return a free block that holds
+ *     one. The caller holds a->lock.
+ */
+static void *grow_heap(arena_t *a, size_t asize)
+{
+    size_t have = 0, size;
+    char *bp;
+
+    /* a free block ending the arena at the brk grows in place */
+    if (a->top != NULL && !GET_PREV_ALLOC(a->top) &&
+	a->top + WSIZE == (char *)mem_heap_hi() + 1)
+	have = MIN(GET_SIZE(a->top - WSIZE), asize - DSIZE);
+
+    if (a->freed >= a->chunk) {
+	/* frees keep up with the misses: add as little as will do */
+	a->chunk = MAX(a->chunk / 2, GROW_MIN);
+	if (have > 0) {
+	    size = asize - have;
+	    a->grow_exact++;
+	}
+	else {
+	    size = MAX(asize, a->chunk);
+	    a->grow_halved++;
+	}
+    }
+    else {
+	/* sustained pressure: take the chunk, the free block included,
+	   and a larger one next time */
+	size = MAX(asize, a->chunk) - have;
+	a->chunk = MIN(a->chunk * 2, GROW_MAX);
+	a->grow_doubled++;
+    }
+    a->freed = 0;
+
+    /* the brk is only ours for sure under grow_lock: another arena may
+       have moved it since, leaving the shortfall in a segment of its own */
+    if ((bp = extend_heap(a, size)) != NULL && GET_SIZE(HDRP(bp)) < asize)
+	bp = extend_heap(a, asize);
+    return bp;
+}
+
 /*
  * place - Place block of asize bytes at start of free block bp
  *         and split if remainder would be at least minimum block size
  */
 /* $begin mmplace */
 /* $begin mmplace-proto */
-static void place(void *bp, size_t asize)
+static void place(arena_t *a, void *bp, size_t asize)
+{
+    place_split(a, bp, asize, SPLIT_MIN);
+}
+/* $end mmplace */
+
+/*
+ * place_split - Place as place does, splitting off a remainder of at
+ *     least split bytes
+ */
+static void place_split(arena_t *a, void *bp, size_t asize, size_t split)
 {
     size_t csize = GET_SIZE(HDRP(bp));
 
-    if ((csize - asize) >= (DSIZE + OVERHEAD)) {
-                         //remove the found block from free list
-                /*If bp is the only pointer in the list, set list to null*/
-             if(GET(PREV_PTR(bp)) == NULL && GET(NEXT_PTR(bp)) == NULL){
-                 root = NULL;
-             }
-             /*If bp is root, make its next the new root*/
-             else if (GET(PREV_PTR(bp)) == NULL && GET(NEXT_PTR(bp)) != NULL){
-               root = GET(NEXT_PTR(bp));
-               PUT(GET(NEXT_PTR(bp)), NULL);
-             }
-             /*If bp is at the end of the list, just remove it from the end*/
-             else if (GET(PREV_PTR(bp)) != NULL && GET(NEXT_PTR(bp)) == NULL){
-                 PUT((GET(PREV_PTR(bp)) + WSIZE), NULL);
-             }
-             /*If bp is in the middle of the list, remove it and fix its next and previous pointers*/
-             else {
-                 PUT((GET(PREV_PTR(bp)) + WSIZE), GET(NEXT_PTR(bp)));
-                 PUT((GET(NEXT_PTR(bp))), GET(PREV_PTR(bp)));
-             }
-             free_list_size--;
-
-	    PUT(HDRP(bp), PACK(asize, 1));
-      PUT(FTRP(bp), PACK(asize, 1));        //set block as allocated
-
-      void* bp_next = NEXT_BLKP(bp);              //go to next block
-	    PUT(HDRP(bp_next), PACK(csize-asize, 0));
-      PUT(FTRP(bp_next), PACK(csize-asize, 0));       // set the next block to free
-
-      	/*Check if list is empty*/
-   	if(free_list_size == 0){
-        	free_list_size++;
-        	root = bp_next;
-        	PUT(PREV_PTR(bp_next), 0);
-        	PUT(NEXT_PTR(bp_next), 0);
-    	}
-    	else{       /*Point bp's next to the old root and make bp the new root*/
-        	free_list_size++;
-        	PUT(root,PREV_PTR(bp_next));
-        	PUT(PREV_PTR(bp_next), 0);
-        	PUT(NEXT_PTR(bp_next), root);
-        	root = bp_next;
-    	}
-	                   //add to free list
+    remove_free_block(a, bp);
+
+    if ((csize - asize) >= split) {
+	PUT(HDRP(bp), PACK(asize, GET_PREV_ALLOC(HDRP(bp)) | 1));  //set block as allocated
+
+	bp = NEXT_BLKP(bp);                   //remainder goes back on a list
+	PUT(HDRP(bp), PACK(csize-asize, PREV_ALLOC));
+	PUT(FTRP(bp), PACK(csize-asize, 0));
+	insert_free_block(a, bp);
     }
     else {
-	     PUT(HDRP(bp), PACK(csize, 1));
-	     PUT(FTRP(bp), PACK(csize, 1));
-       		/*If bp is the only pointer in the list, set list to null*/
-    	     if(GET(PREV_PTR(bp)) == NULL && GET(NEXT_PTR(bp)) == NULL){
-                 root = NULL;
-             }
-             /*If bp is root, make its next the new root*/
-             else if (GET(PREV_PTR(bp)) == NULL && GET(NEXT_PTR(bp)) != NULL){
-               root = GET(NEXT_PTR(bp));
-               PUT(GET(NEXT_PTR(bp)), NULL);
-             }
-             /*If bp is at the end of the list, just remove it from the end*/
-             else if (GET(PREV_PTR(bp)) != NULL && GET(NEXT_PTR(bp)) == NULL){
-                 PUT((GET(PREV_PTR(bp)) + WSIZE), NULL);
-             }
-             /*If bp is in the middle of the list, remove it and fix its next and previous nodes*/
-             else {
-                 PUT((GET(PREV_PTR(bp)) + WSIZE), GET(NEXT_PTR(bp)));
-                 PUT((GET(NEXT_PTR(bp))), GET(PREV_PTR(bp)));
-             }
-             free_list_size--;                // becuase there is no other free block, simply remove from free list because there are not other free blocks
+	PUT(HDRP(bp), PACK(csize, GET_PREV_ALLOC(HDRP(bp)) | 1));
+	bp = NEXT_BLKP(bp);
+	SET_PREV_ALLOC(HDRP(bp));
+    }
+    DIRTY_TO(a, bp);
+}
+
+/*
+ * place_batch - Carve up to n blocks of asize bytes back to back from
+ *     the start of free block bp, storing them in out, and return how
+ *     many fit. The rest is split off as in place, or absorbed by the
+ *     last block if it is too small to be a block of its own.
+ */
+static size_t place_batch(arena_t *a, char *bp, size_t asize, size_t n, void **out)
+{
+    size_t csize = GET_SIZE(HDRP(bp));
+    size_t pa = GET_PREV_ALLOC(HDRP(bp));
+    size_t i;
+
+    remove_free_block(a, bp);
+    if (n > csize / asize)
+	n = csize / asize;
+
+    for (i = 0; i < n; i++) {
+	if (i == n-1 && csize - asize < SPLIT_MIN)
+	    asize = csize;
+	PUT(HDRP(bp), PACK(asize, pa | 1));
+	out[i] = bp;
+	pa = PREV_ALLOC;
+	csize -= asize;
+	bp += asize;
     }
 
+    if (csize > 0) {                          //remainder goes back on a list
+	PUT(HDRP(bp), PACK(csize, PREV_ALLOC));
+	PUT(FTRP(bp), PACK(csize, 0));
+	insert_free_block(a, bp);
+    }
+    else
+	SET_PREV_ALLOC(HDRP(bp));
+    DIRTY_TO(a, bp);
+    return n;
 }
-/* $end mmplace */
 
 /*
- * find_fit - Find a fit for a block with asize bytes
+ * free_block - Return allocated block bp to arena a's free structures
+ */
+static void free_block(arena_t *a, void *bp)
+{
+    size_t size = GET_SIZE(HDRP(bp));
+
+    PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp))));
+    PUT(FTRP(bp), PACK(size, 0));     //free blocks get their footer back
+    a->freed += size;
+
+    trim_top(a, coalesce(a, bp));    //merge with free neighbors and file under its class
+}
+
+/*
+ * trim_top - Shrink the heap if free block bp ends it and is larger
+ *     than TRIM_THRESHOLD, keeping TRIM_KEEP bytes for future requests
+ */
+static void trim_top(arena_t *a, char *bp)
+{
+    size_t size = GET_SIZE(HDRP(bp));
+    size_t trim;
+
+    if (size <= TRIM_THRESHOLD || HDRP(NEXT_BLKP(bp)) != a->top)
+	return;
+
+    pthread_mutex_lock(&grow_lock);
+    if (a->top + WSIZE == (char *)mem_heap_hi() + 1) {
+	/* whole pages only, so the brk stays page aligned */
+	trim = (size - TRIM_KEEP) & ~(size_t)(PAGESIZE-1);
+	remove_free_block(a, bp);
+	if (mem_sbrk(-(intptr_t)trim) != (void *)-1) {
+	    size -= trim;
+	    PUT(a->top_seg, GET(a->top_seg) - trim);
+	    PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp))));
+	    PUT(FTRP(bp), PACK(size, 0));
+	    a->top = HDRP(NEXT_BLKP(bp));
+	    PUT(a->top, PACK(0, 1));          /* new epilogue header */
+	}
+	insert_free_block(a, bp);
+    }
+    pthread_mutex_unlock(&grow_lock);
+}
+
+/*
+ * place_aligned - Allocate a block of exactly asize bytes from arena
+ *     a whose payload starts on an align boundary, align being a power
+ *     of two. Leading slack stays a free block, and so does trailing
+ *     slack, whatever SPLIT_MIN says: slabs and nurseries must be
+ *     exactly their size. The block searched for is large enough that
+ *     the trailing slack is never too small to be a block.
  */
-static void *find_fit(size_t asize)
+static void *place_aligned(arena_t *a, size_t align, size_t asize)
 {
-#ifdef NEXT_FIT
-    /* next fit search */
-    char *oldrover = rover;-
+    /* room for any leading slack and a trailing one that can be split */
+    size_t need = asize + align + 2*MIN_BLOCK;
+    size_t csize, lead;
+    char *bp;
 
-    /* search from the rover to the end of list */
-    for ( ; GET_SIZE(HDRP(rover)) > 0; rover = NEXT_BLKP(rover))
-	if (!GET_ALLOC(HDRP(rover)) && (asize <= GET_SIZE(HDRP(rover))))
-	    return rover;
+    if ((bp = find_fit(a, need)) == NULL &&
+	(bp = grow_heap(a, need)) == NULL)
+	return NULL;
+
+    /* slack before the boundary must be empty or a whole free block */
+    lead = (((size_t)bp + align-1) & ~(align-1)) - (size_t)bp;
+    if (lead != 0 && lead < MIN_BLOCK)
+	lead += align;
+    if (lead != 0) {
+	csize = GET_SIZE(HDRP(bp));
+	remove_free_block(a, bp);
+	PUT(HDRP(bp), PACK(lead, GET_PREV_ALLOC(HDRP(bp))));
+	PUT(FTRP(bp), PACK(lead, 0));
+	insert_free_block(a, bp);
+
+	bp += lead;
+	PUT(HDRP(bp), PACK(csize-lead, 0));
+	PUT(FTRP(bp), PACK(csize-lead, 0));
+	insert_free_block(a, bp);
+    }
+    place_split(a, bp, asize, MIN_BLOCK);
+    return bp;
+}
 
-    /* search from start of list to old rover */
-    for (rover = heap_listp; rover < oldrover; rover = NEXT_BLKP(rover))
-	     if (!GET_ALLOC(HDRP(rover)) && (asize <= GET_SIZE(HDRP(rover))))
-	    return rover;
+/*
+ * slab_alloc - Take a free object of class cls from arena a, starting
+ *     a new slab if the class has none with room
+ */
+static void *slab_alloc(arena_t *a, int cls)
+{
+    slab_t *s = a->slabs[cls];
+    int i, n;
+
+    if (s == NULL) {
+	if ((s = place_aligned(a, PAGESIZE, PAGESIZE)) == NULL)
+	    return NULL;
+	page_arena[PAGE_INDEX(s)] |= SLAB_PAGE;
+
+	n = SLAB_CAP(cls);
+	memset(s->map, 0, sizeof(s->map));
+	for (i = 0; i < n / 32; i++)
+	    s->map[i] = ~0U;
+	if (n % 32)
+	    s->map[i] = (1U << (n % 32)) - 1;
+	s->cls = cls;
+	s->nfree = n;
+	s->prev = NULL;
+	s->next = NULL;
+	a->slabs[cls] = s;
+    }
+
+    for (i = 0; s->map[i] == 0; i++)
+	;
+    n = FFS(s->map[i]);
+    s->map[i] &= ~(1U << n);
+    if (--s->nfree == 0)
+	slab_unlink(a, s);      /* full slabs are on no list */
+
+    return (char *)s + SLAB_FIRST + (i*32 + n) * SLAB_OSIZE(cls);
+}
+
+/*
+ * slab_free - Return object p to its slab, and the slab to the heap if
+ *     it is now empty and another slab of its class has room
+ */
+static void slab_free(arena_t *a, void *p)
+{
+    slab_t *s = SLAB_OF(p);
+    int n = ((char *)p - (char *)s - SLAB_FIRST) / SLAB_OSIZE(s->cls);
+
+    s->map[n / 32] |= 1U << (n % 32);
+    if (s->nfree++ == 0) {      /* was full: back on its list */
+	s->prev = NULL;
+	s->next = a->slabs[s->cls];
+	if (s->next != NULL)
+	    s->next->prev = s;
+	a->slabs[s->cls] = s;
+    }
+    else if (s->nfree == SLAB_CAP(s->cls) && (s->next != NULL || s->prev != NULL)) {
+	slab_unlink(a, s);
+	page_arena[PAGE_INDEX(s)] &= ~SLAB_PAGE;
+	free_block(a, s);
+    }
+}
+
+/*
+ * slab_unlink - Remove slab s from its class list in arena a
+ */
+static void slab_unlink(arena_t *a, slab_t *s)
+{
+    if (s->next != NULL)
+	s->next->prev = s->prev;
+    if (s->prev != NULL)
+	s->prev->next = s->next;
+    else
+	a->slabs[s->cls] = s->next;
+}
+
+/*
+ * nursery_alloc - Bump allocate a size byte object from arena a's
+ *     nursery, starting a new nursery if it is full. A new nursery is
+ *     exactly NURSERY_SIZE bytes, as place_aligned promises, so every
+ *     byte of it is on a page marked NURSERY_PAGE.
+ */
+static void *nursery_alloc(arena_t *a, size_t size)
+{
+    nursery_t *n = a->nursery;
+    size_t osize = (size + OVERHEAD + DSIZE-1) & ~(size_t)(DSIZE-1);
+    char *p;
+
+    if (n == NULL || n->bump + osize > (char *)n + NURSERY_SIZE) {
+	/* the full one is retired until its last object is freed */
+	if ((n = a->spare) != NULL)
+	    a->spare = NULL;
+	else if ((n = place_aligned(a, NURSERY_SIZE, NURSERY_SIZE)) == NULL)
+	    return NULL;
+	else
+	    memset(page_arena + PAGE_INDEX(n), (a - arenas) | NURSERY_PAGE,
+		   NURSERY_SIZE >> PAGE_SHIFT);
+	n->bump = (char *)n + NURSERY_FIRST;
+	n->live = 0;
+	a->nursery = n;
+    }
+
+    p = n->bump;
+    PUT(HDRP(p), PACK(osize, 1));
+    n->bump += osize;
+    n->live++;
+    return p;
+}
+
+/*
+ * nursery_free - Free object p of its nursery, and once the nursery
+ *     has no live objects left, start it over if it is arena a's
+ *     current one, or keep it as the spare if there is none, or give
+ *     it back to the heap
+ */
+static void nursery_free(arena_t *a, void *p)
+{
+    nursery_t *n = NURSERY_OF(p);
+
+    PUT(HDRP(p), GET(HDRP(p)) & ~1);  /* so mm_checkheap can count */
+    if (--n->live > 0)
+	return;
+    n->bump = (char *)n + NURSERY_FIRST;
+    if (n == a->nursery)
+	return;
+    if (a->spare == NULL) {           /* saves place_aligned's slack */
+	a->spare = n;
+	return;
+    }
+    memset(page_arena + PAGE_INDEX(n), a - arenas, NURSERY_SIZE >> PAGE_SHIFT);
+    free_block(a, n);
+}
+
+/*
+ * adjust_size - Block size needed for a request of size payload bytes,
+ *     including overhead and alignment reqs.
+ */
+static size_t adjust_size(size_t size)
+{
+    size_t asize = DSIZE * ((size + (OVERHEAD) + (DSIZE-1)) / DSIZE);
+
+    return MAX(asize, MIN_BLOCK);
+}
+
+/*
+ * shrink_block - Trim allocated block bp to asize bytes and free the
+ *     tail if the remainder would be at least minimum block size
+ */
+static void shrink_block(arena_t *a, void *bp, size_t asize)
+{
+    size_t csize = GET_SIZE(HDRP(bp));
+
+    if ((csize - asize) < SPLIT_MIN)
+	return;
+
+    PUT(HDRP(bp), PACK(asize, GET_PREV_ALLOC(HDRP(bp)) | 1));
+
+    bp = NEXT_BLKP(bp);                   //tail may merge with a free successor
+    PUT(HDRP(bp), PACK(csize-asize, PREV_ALLOC));
+    PUT(FTRP(bp), PACK(csize-asize, 0));
+    trim_top(a, coalesce(a, bp));
+}
+
+/*
+ * find_fit - Find a fit for a block with asize bytes
+ */
+static void *find_fit(arena_t *a, size_t asize)
+{
+#if FIT == FIT_NEXT
+    /* next fit search over the arena's blocks, from the rover around */
+    char *oldrover = a->rover;
+
+    if (oldrover == NULL)
+	return NULL;
+    do {
+	if (!GET_ALLOC(HDRP(a->rover)) && (asize <= GET_SIZE(HDRP(a->rover))))
+	    return a->rover;
+	a->rover = next_arena_block(a, a->rover);
+    } while (a->rover != oldrover);
 
     return NULL;  /* no fit found */
 #else
-    /* first fit search */
-    void *bp = root;
-      /*Traverse through free list using next pointers*/
-      for (int i = 0; i < free_list_size; i++){
-        if (!GET_ALLOC(HDRP(bp)) && asize <= GET_SIZE(HDRP(bp))){
-          return bp;
-        }
-        bp = GET(NEXT_PTR(bp));
-      }
+    /* segregated fit search */
+    char *bp;
+    int fl, sl;
+
+    if (asize >= LARGE_BLOCK)
+	return tree_search(a, asize);
+
+    /* asize's own class holds blocks both smaller and larger than it */
+    mapping_insert(asize, &fl, &sl);
+#if FIT == FIT_GOOD
+    /*
+     * The head of asize's own class costs one compare to try and keeps
+     * exact-size reuse working; every other block in that class may be
+     * too small, so the bitmap search starts one class up.
+     */
+    if ((bp = a->free_lists[fl][sl]) != NULL && asize <= GET_SIZE(HDRP(bp)))
+	return bp;
+#else
+    if ((bp = list_fit(a->free_lists[fl][sl], asize)) != NULL)
+	return bp;
+#endif
+
+    /* every block in the classes above fits, and the tree's blocks too */
+    if (!class_search(a, asize, &fl, &sl))
+	return tree_search(a, asize);
+#if FIT == FIT_BEST
+    return list_fit(a->free_lists[fl][sl], asize);
+#else
+    return a->free_lists[fl][sl];
+#endif
+#endif
+}
+
+#if FIT == FIT_FIRST || FIT == FIT_BEST
+/*
+ * list_fit - Return a block of at least asize bytes on the class list
+ *     that starts at bp, or NULL: the first in list order, or with
+ *     FIT_BEST the smallest
+ */
+static void *list_fit(char *bp, size_t asize)
+{
+#if FIT == FIT_BEST
+    char *fit = NULL;
 
-    return NULL; /* no fit */
+    for (; bp != NULL; bp = GET_PTR(NEXT_PTR(bp))) {
+	if (GET_SIZE(HDRP(bp)) == asize)
+	    return bp;
+	if (GET_SIZE(HDRP(bp)) > asize &&
+	    (fit == NULL || GET_SIZE(HDRP(bp)) < GET_SIZE(HDRP(fit))))
+	    fit = bp;
+    }
+    return fit;
+#else
+    for (; bp != NULL; bp = GET_PTR(NEXT_PTR(bp)))
+	if (GET_SIZE(HDRP(bp)) >= asize)
+	    return bp;
+    return NULL;
 #endif
 }
+#endif
+
+#if FIT != FIT_NEXT
+/*
+ * class_search - Find the first nonempty class (fl, sl) of arena a's
+ *     lists whose blocks are all at least asize bytes. Returns 0 if
+ *     there is none, and only a large block can fit.
+ */
+static int class_search(arena_t *a, size_t asize, int *fl, int *sl)
+{
+    unsigned int sl_map, fl_map;
+
+    mapping_search(asize, fl, sl);
+    if (*fl >= FL_COUNT)
+	return 0;
+
+    sl_map = a->sl_bitmap[*fl] & (~0U << *sl);
+    if (!sl_map) {
+	fl_map = (*fl + 1 < FL_COUNT) ? a->fl_bitmap & (~0U << (*fl + 1)) : 0;
+	if (!fl_map)
+	    return 0;
+	*fl = FFS(fl_map);
+	sl_map = a->sl_bitmap[*fl];
+    }
+    *sl = FFS(sl_map);
+    return 1;
+}
+#endif
+
+#if FIT == FIT_NEXT
+/*
+ * next_arena_block - Return the block after bp in arena a, moving on to
+ *     the arena's next segment (wrapping at the brk) at an epilogue.
+ *     Other arenas grow and trim their segments, and move the brk,
+ *     under grow_lock only, so the segments are walked holding it.
+ */
+static char *next_arena_block(arena_t *a, char *bp)
+{
+    char *seg;
+
+    bp = NEXT_BLKP(bp);
+    if (GET_SIZE(HDRP(bp)) > 0)
+	return bp;
+
+    pthread_mutex_lock(&grow_lock);
+    for (seg = bp; ; seg = NEXT_SEG(seg)) {   /* epilogue ends its segment */
+	if (seg >= (char *)mem_heap_hi())
+	    seg = mem_heap_lo();
+	if (arena_of(seg) == a)
+	    break;
+    }
+    pthread_mutex_unlock(&grow_lock);
+    return SEG_FIRST(seg);
+}
+#endif
 
 
 /*
  * coalesce - boundary tag coalescing. Return ptr to coalesced block
  */
-static void *coalesce(void *bp)
+static void *coalesce(arena_t *a, void *bp)
 {
-    size_t prev_alloc = GET_ALLOC(HDRP(PREV_BLKP(bp)));
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
     size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
     size_t size = GET_SIZE(HDRP(bp));
-    size_t allocated_blocks = prev_alloc + next_alloc;
-//    printf("before prev and next declarations \n");
 
-    void *bp_prev = PREV_BLKP(bp);
-    void *bp_next = NEXT_BLKP(bp);
-  //  printf("both = %d \n", allocated_blocks);
-//  printf("after prev and next declarations \n");
+    /*
+     * A free neighbor always has an allocated neighbor on its far side,
+     * so whichever block heads the result has an allocated predecessor.
+     */
+    if (prev_alloc && next_alloc) {            /* Case 1 */
+    }
 
-    switch (allocated_blocks) {
-      case 2:
-    //    printf("case 2 \n");
-        break;
-      case 1:
-    //  printf("case 1 \n");
-
-        if (prev_alloc){
-      //    printf("case 1 prev_alloc is allocated \n");
-
-                void *next_ptr = GET(NEXT_PTR(bp_next));
-                void *prev_ptr = GET(PREV_PTR(bp_next));
-              //  printf("next_ptr = %p \n", next_ptr);
-              //  printf("prev_ptr = %p \n", prev_ptr);
-
-                        /*If bp is the only pointer in the list, set list to null*/
-                     if(prev_ptr == NULL && next_ptr == NULL){
-                         root = NULL;
-                     }
-                     /*If bp is root, make its next the new root*/
-                     else if (prev_ptr == NULL && next_ptr != NULL){
-                       root = GET(NEXT_PTR(bp_next));
-                       PUT(GET(NEXT_PTR(bp_next)), NULL);
-                     }
-                     /*If bp is at the end of the list, just remove it from the end*/
-                     else if (prev_ptr != NULL && next_ptr == NULL){
-                         PUT((GET(PREV_PTR(bp_next)) + WSIZE), NULL);
-                     }
-                     /*If bp is in the middle of the list, remove it and fix its next and previous pointer*/
-                     else {
-                         PUT((GET(PREV_PTR(bp_next)) + WSIZE), GET(NEXT_PTR(bp_next)));
-                         PUT((GET(NEXT_PTR(bp_next))), GET(PREV_PTR(bp_next)));
-                     }
-                     free_list_size--;
-
-              size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
-
-              PUT(HDRP(bp), PACK(size, 0));
-              PUT(FTRP(bp), PACK(size,0));
-        }
-        else {    //next block is allocated
-        //  printf("case 1 next_alloc is allocated \n");
-
-          void *next_ptr = GET(NEXT_PTR(bp_prev));
-          void *prev_ptr = GET(PREV_PTR(bp_prev));
-        //  printf("pointers declared \n");
-
-           	     /*If bp is the only pointer in the list, set list to null*/
-              if(prev_ptr == NULL && next_ptr == NULL){
-                  root = NULL;
-              }
-              /*If bp is root, make its next the new root*/
-              else if (prev_ptr == NULL && next_ptr != NULL){
-                root = GET(NEXT_PTR(bp_prev));
-                PUT(GET(NEXT_PTR(bp_prev)), NULL);
-              }
-              /*If bp is at the end of the list, just remove it from the end*/
-              else if (prev_ptr != NULL && next_ptr == NULL){
-                  PUT((GET(PREV_PTR(bp_prev)) + WSIZE), NULL);
-              }
-              /*If bp is in the middle of the list, remove it and fix its next and previous pointer*/
-              else {
-                  PUT((GET(PREV_PTR(bp_prev)) + WSIZE), GET(NEXT_PTR(bp_prev)));
-                  PUT((GET(NEXT_PTR(bp_prev))), GET(PREV_PTR(bp_prev)));
-              }
-              free_list_size--;
-          //    printf("after big if else chunk \n");
-          //    printf("next_ptr = %p \n", next_ptr);
-          //    printf("prev_ptr = %p \n", prev_ptr);
-
-        	    size += GET_SIZE(HDRP(PREV_BLKP(bp)));
-            //  printf("here 1");
-
-              PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
-            //  printf("here 2");
-
-        	    PUT(FTRP(bp), PACK(size, 0));
-              //printf("here 3");
-
-              bp = PREV_BLKP(bp);
-            //  printf("done with case");
+    else if (prev_alloc && !next_alloc) {      /* Case 2 */
+	remove_free_block(a, NEXT_BLKP(bp));
+	size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
+	PUT(HDRP(bp), PACK(size, PREV_ALLOC));
+	PUT(FTRP(bp), PACK(size,0));
+    }
 
-        }
-        break;
-      default:
-    //  printf("default \n");
-
-           /*If bp is the only pointer in the list, set list to null*/
-           if(GET(PREV_PTR(bp_prev)) == NULL && GET(NEXT_PTR(bp_prev)) == NULL){
-               root = NULL;
-           }
-           /*If bp is root, make its next the new root*/
-           else if (GET(PREV_PTR(bp_prev)) == NULL && GET(NEXT_PTR(bp_prev)) != NULL){
-             root = GET(NEXT_PTR(bp_prev));
-             PUT(GET(NEXT_PTR(bp_prev)), NULL);
-           }
-           /*If bp is at the end of the list, just remove it from the end*/
-           else if (GET(PREV_PTR(bp_prev)) != NULL && GET(NEXT_PTR(bp_prev)) == NULL){
-               PUT((GET(PREV_PTR(bp_prev)) + WSIZE), NULL);
-           }
-           /*If bp is in the middle of the list, remove it and fix its next and previous pointer*/
-           else {
-               PUT((GET(PREV_PTR(bp_prev)) + WSIZE), GET(NEXT_PTR(bp_prev)));
-               PUT((GET(NEXT_PTR(bp_prev))), GET(PREV_PTR(bp_prev)));
-           }
-
-              /*If bp is the only pointer in the list, set list to null*/
-           if(GET(PREV_PTR(bp_next)) == NULL && GET(NEXT_PTR(bp_next)) == NULL){
-               root = NULL;
-           }
-           /*If bp is root, make its next the new root*/
-           else if (GET(PREV_PTR(bp_next)) == NULL && GET(NEXT_PTR(bp_next)) != NULL){
-             root = GET(NEXT_PTR(bp_next));
-             PUT(GET(NEXT_PTR(bp_next)), NULL);
-           }
-           /*If bp is at the end of the list, just remove it from the end*/
-           else if (GET(PREV_PTR(bp_next)) != NULL && GET(NEXT_PTR(bp_next)) == NULL){
-               PUT((GET(PREV_PTR(bp_next)) + WSIZE), NULL);
-           }
-           /*If bp is in the middle of the list, remove it and fix its next and previous pointer*/
-           else {
-               PUT((GET(PREV_PTR(bp_next)) + WSIZE), GET(NEXT_PTR(bp_next)));
-               PUT((GET(NEXT_PTR(bp_next))), GET(PREV_PTR(bp_next)));
-           }
-           free_list_size = free_list_size - 2;
-
-    size += GET_SIZE(HDRP(PREV_BLKP(bp))) + GET_SIZE(FTRP(NEXT_BLKP(bp)));
-
-    PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
-    PUT(FTRP(NEXT_BLKP(bp)), PACK(size, 0));
-    bp = PREV_BLKP(bp);
-        break;
+    else if (!prev_alloc && next_alloc) {      /* Case 3 */
+	remove_free_block(a, PREV_BLKP(bp));
+	size += GET_SIZE(HDRP(PREV_BLKP(bp)));
+	PUT(FTRP(bp), PACK(size, 0));
+	PUT(HDRP(PREV_BLKP(bp)), PACK(size, PREV_ALLOC));
+	bp = PREV_BLKP(bp);
+    }
+
+    else {                                     /* Case 4 */
+	remove_free_block(a, PREV_BLKP(bp));
+	remove_free_block(a, NEXT_BLKP(bp));
+	size += GET_SIZE(HDRP(PREV_BLKP(bp))) +
+	    GET_SIZE(FTRP(NEXT_BLKP(bp)));
+	PUT(HDRP(PREV_BLKP(bp)), PACK(size, PREV_ALLOC));
+	PUT(FTRP(NEXT_BLKP(bp)), PACK(size, 0));
+	bp = PREV_BLKP(bp);
     }
 
+    /* the block after a free block never has pa set */
+    CLR_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
 
-#ifdef NEXT_FIT
+#if FIT == FIT_NEXT
     /* Make sure the rover isn't pointing into the free block */
     /* that we just coalesced */
-    if ((rover > (char *)bp) && (rover < NEXT_BLKP(bp)))
-	rover = bp;
+    if ((a->rover > (char *)bp) && (a->rover < NEXT_BLKP(bp)))
+	a->rover = bp;
 #endif
 
-         /*Check if list is empty*/
-        if(free_list_size == 0){
-             free_list_size++;
-             root = bp;
-             PUT(PREV_PTR(bp), 0);
-             PUT(NEXT_PTR(bp), 0);
-        }
-        else{       /*Point bp's next to the old root and make bp the new root*/
-             free_list_size++;
-             PUT(root,PREV_PTR(bp));
-             PUT(PREV_PTR(bp), 0);
-             PUT(NEXT_PTR(bp), root);
-             root = bp;
-        }
+    insert_free_block(a, bp);
     return bp;
 }
 
+/*
+ * mapping_insert - Compute the class (fl, sl) that a free block of
+ *     the given size is filed under
+ */
+static void mapping_insert(size_t size, int *fl, int *sl)
+{
+    int f;
+
+    if (size < SMALL_BLOCK) {
+	*fl = 0;
+	*sl = (int)(size >> ALIGN_SHIFT);
+    }
+    else {
+	f = FLS(size);
+	*sl = (int)(size >> (f - SL_SHIFT)) ^ SL_COUNT;
+	*fl = f - FL_SHIFT + 1;
+    }
+}
+
+#if FIT != FIT_NEXT
+/*
+ * mapping_search - Compute the smallest class (fl, sl) whose blocks
+ *     are all at least size bytes, by rounding size up to the next
+ *     class boundary before mapping it
+ */
+static void mapping_search(size_t size, int *fl, int *sl)
+{
+    if (size >= SMALL_BLOCK)
+	size += ((size_t)1 << (FLS(size) - SL_SHIFT)) - 1;
+    mapping_insert(size, fl, sl);
+}
+#endif
+
+/*
+ * insert_free_block - Add free block bp to its class list, where the
+ *     INSERT policy says, or to the tree if it is large
+ */
+static void insert_free_block(arena_t *a, void *bp)
+{
+    char *prev = NULL, *next;
+    int fl, sl;
+
+    if (GET_SIZE(HDRP(bp)) >= LARGE_BLOCK) {
+	tree_insert(a, bp);
+	return;
+    }
+
+    mapping_insert(GET_SIZE(HDRP(bp)), &fl, &sl);
+    next = a->free_lists[fl][sl];
+#if INSERT == INSERT_FIFO
+    if (next != NULL) {
+	prev = a->free_tails[fl][sl];
+	next = NULL;
+    }
+    a->free_tails[fl][sl] = bp;
+#elif INSERT == INSERT_ADDR
+    while (next != NULL && next < (char *)bp) {
+	prev = next;
+	next = GET_PTR(NEXT_PTR(next));
+    }
+#endif
+
+    PUT_PTR(PREV_PTR(bp), prev);
+    PUT_PTR(NEXT_PTR(bp), next);
+    if (next != NULL)
+	PUT_PTR(PREV_PTR(next), bp);
+    if (prev != NULL)
+	PUT_PTR(NEXT_PTR(prev), bp);
+    else
+	a->free_lists[fl][sl] = bp;
+
+    a->fl_bitmap |= 1U << fl;
+    a->sl_bitmap[fl] |= 1U << sl;
+}
+
+/*
+ * remove_free_block - Unlink free block bp from its class list or tree
+ */
+static void remove_free_block(arena_t *a, void *bp)
+{
+    char *prev, *next;
+    int fl, sl;
+
+    if (GET_SIZE(HDRP(bp)) >= LARGE_BLOCK) {
+	tree_remove(a, bp);
+	return;
+    }
+
+    prev = GET_PTR(PREV_PTR(bp));
+    next = GET_PTR(NEXT_PTR(bp));
+#if INSERT == INSERT_FIFO
+    if (next == NULL) {
+	mapping_insert(GET_SIZE(HDRP(bp)), &fl, &sl);
+	a->free_tails[fl][sl] = prev;
+    }
+#endif
+    if (next != NULL)
+	PUT_PTR(PREV_PTR(next), prev);
+    if (prev != NULL) {
+	PUT_PTR(NEXT_PTR(prev), next);
+	return;
+    }
+
+    /* bp was the head of its list */
+    mapping_insert(GET_SIZE(HDRP(bp)), &fl, &sl);
+    a->free_lists[fl][sl] = next;
+    if (next == NULL) {
+	a->sl_bitmap[fl] &= ~(1U << sl);
+	if (!a->sl_bitmap[fl])
+	    a->fl_bitmap &= ~(1U << fl);
+    }
+}
+
+
+#if FIT != FIT_NEXT
+/*
+ * tree_search - Return the best fit for asize bytes among arena a's
+ *     large blocks: the smallest that fits, lowest address first
+ */
+static void *tree_search(arena_t *a, size_t asize)
+{
+    char *bp = a->tree_root;
+    char *fit = NULL;
+
+    while (bp != NULL) {
+	if (GET_SIZE(HDRP(bp)) >= asize) {
+	    fit = bp;             /* fits; look for a smaller one */
+	    bp = LEFT(bp);
+	}
+	else
+	    bp = RIGHT(bp);
+    }
+    return fit;
+}
+#endif
+
+/*
+ * tree_insert - Add large free block bp to arena a's tree
+ */
+static void tree_insert(arena_t *a, char *bp)
+{
+    char *parent = NULL;
+    char **link = &a->tree_root;
+
+    while (*link != NULL) {
+	parent = *link;
+	link = (char **)(TREE_LESS(bp, parent) ? LEFT_PTR(parent) : RIGHT_PTR(parent));
+    }
+    PUT_PTR(LEFT_PTR(bp), NULL);
+    PUT_PTR(RIGHT_PTR(bp), NULL);
+    PUT_PTR(PARENT_PTR(bp), parent);
+    SET_COLOR(bp, RED);
+    *link = bp;
+
+    tree_insert_fixup(a, bp);
+}
+
+/*
+ * tree_insert_fixup - Restore the red-black properties after red node
+ *     x was linked in as a leaf
+ */
+static void tree_insert_fixup(arena_t *a, char *x)
+{
+    char *p, *g, *u;
+
+    while ((p = PARENT(x)) != NULL && IS_RED(p)) {
+	g = PARENT(p);            /* a red node is never the root */
+	if (p == LEFT(g)) {
+	    u = RIGHT(g);
+	    if (IS_RED(u)) {      /* red uncle: recolor and move up */
+		SET_COLOR(p, BLACK);
+		SET_COLOR(u, BLACK);
+		SET_COLOR(g, RED);
+		x = g;
+		continue;
+	    }
+	    if (x == RIGHT(p)) {
+		rotate_left(a, p);
+		x = p;
+		p = PARENT(x);
+	    }
+	    SET_COLOR(p, BLACK);
+	    SET_COLOR(g, RED);
+	    rotate_right(a, g);
+	}
+	else {
+	    u = LEFT(g);
+	    if (IS_RED(u)) {
+		SET_COLOR(p, BLACK);
+		SET_COLOR(u, BLACK);
+		SET_COLOR(g, RED);
+		x = g;
+		continue;
+	    }
+	    if (x == LEFT(p)) {
+		rotate_right(a, p);
+		x = p;
+		p = PARENT(x);
+	    }
+	    SET_COLOR(p, BLACK);
+	    SET_COLOR(g, RED);
+	    rotate_left(a, g);
+	}
+    }
+    SET_COLOR(a->tree_root, BLACK);
+}
+
+/*
+ * tree_remove - Unlink large free block z from arena a's tree
+ */
+static void tree_remove(arena_t *a, char *z)
+{
+    char *x, *xp, *y;
+    int color = GET(COLOR_PTR(z));
+
+    if (LEFT(z) == NULL) {
+	x = RIGHT(z);
+	xp = PARENT(z);
+	tree_replace(a, z, x);
+    }
+    else if (RIGHT(z) == NULL) {
+	x = LEFT(z);
+	xp = PARENT(z);
+	tree_replace(a, z, x);
+    }
+    else {
+	/* two children: z's successor y takes its place */
+	for (y = RIGHT(z); LEFT(y) != NULL; y = LEFT(y))
+	    ;
+	color = GET(COLOR_PTR(y));
+	x = RIGHT(y);
+	if (PARENT(y) == z)
+	    xp = y;
+	else {
+	    xp = PARENT(y);
+	    tree_replace(a, y, x);
+	    PUT_PTR(RIGHT_PTR(y), RIGHT(z));
+	    PUT_PTR(PARENT_PTR(RIGHT(y)), y);
+	}
+	tree_replace(a, z, y);
+	PUT_PTR(LEFT_PTR(y), LEFT(z));
+	PUT_PTR(PARENT_PTR(LEFT(y)), y);
+	SET_COLOR(y, GET(COLOR_PTR(z)));
+    }
+
+    if (color == BLACK)
+	tree_remove_fixup(a, x, xp);
+}
+
+/*
+ * tree_remove_fixup - Restore the red-black properties after a black
+ *     node was removed above x, a possibly NULL child of xp
+ */
+static void tree_remove_fixup(arena_t *a, char *x, char *xp)
+{
+    char *w;
+
+    while (x != a->tree_root && !IS_RED(x)) {
+	if (x == LEFT(xp)) {
+	    w = RIGHT(xp);        /* x is short a black, so w exists */
+	    if (IS_RED(w)) {
+		SET_COLOR(w, BLACK);
+		SET_COLOR(xp, RED);
+		rotate_left(a, xp);
+		w = RIGHT(xp);
+	    }
+	    if (!IS_RED(LEFT(w)) && !IS_RED(RIGHT(w))) {
+		SET_COLOR(w, RED);
+		x = xp;
+		xp = PARENT(x);
+		continue;
+	    }
+	    if (!IS_RED(RIGHT(w))) {
+		SET_COLOR(LEFT(w), BLACK);
+		SET_COLOR(w, RED);
+		rotate_right(a, w);
+		w = RIGHT(xp);
+	    }
+	    SET_COLOR(w, GET(COLOR_PTR(xp)));
+	    SET_COLOR(xp, BLACK);
+	    SET_COLOR(RIGHT(w), BLACK);
+	    rotate_left(a, xp);
+	}
+	else {
+	    w = LEFT(xp);
+	    if (IS_RED(w)) {
+		SET_COLOR(w, BLACK);
+		SET_COLOR(xp, RED);
+		rotate_right(a, xp);
+		w = LEFT(xp);
+	    }
+	    if (!IS_RED(LEFT(w)) && !IS_RED(RIGHT(w))) {
+		SET_COLOR(w, RED);
+		x = xp;
+		xp = PARENT(x);
+		continue;
+	    }
+	    if (!IS_RED(LEFT(w))) {
+		SET_COLOR(RIGHT(w), BLACK);
+		SET_COLOR(w, RED);
+		rotate_left(a, w);
+		w = LEFT(xp);
+	    }
+	    SET_COLOR(w, GET(COLOR_PTR(xp)));
+	    SET_COLOR(xp, BLACK);
+	    SET_COLOR(LEFT(w), BLACK);
+	    rotate_right(a, xp);
+	}
+	x = a->tree_root;
+    }
+    if (x != NULL)
+	SET_COLOR(x, BLACK);
+}
+
+/*
+ * tree_replace - Put subtree v (possibly NULL) where node u hangs
+ */
+static void tree_replace(arena_t *a, char *u, char *v)
+{
+    char *p = PARENT(u);
+
+    if (v != NULL)
+	PUT_PTR(PARENT_PTR(v), p);
+    if (p == NULL)
+	a->tree_root = v;
+    else if (u == LEFT(p))
+	PUT_PTR(LEFT_PTR(p), v);
+    else
+	PUT_PTR(RIGHT_PTR(p), v);
+}
+
+/*
+ * rotate_left - Make x's right child the root of x's subtree
+ */
+static void rotate_left(arena_t *a, char *x)
+{
+    char *y = RIGHT(x);
+
+    PUT_PTR(RIGHT_PTR(x), LEFT(y));
+    if (LEFT(y) != NULL)
+	PUT_PTR(PARENT_PTR(LEFT(y)), x);
+    tree_replace(a, x, y);
+    PUT_PTR(LEFT_PTR(y), x);
+    PUT_PTR(PARENT_PTR(x), y);
+}
+
+/*
+ * rotate_right - Make x's left child the root of x's subtree
+ */
+static void rotate_right(arena_t *a, char *x)
+{
+    char *y = LEFT(x);
+
+    PUT_PTR(LEFT_PTR(x), RIGHT(y));
+    if (RIGHT(y) != NULL)
+	PUT_PTR(PARENT_PTR(RIGHT(y)), x);
+    tree_replace(a, x, y);
+    PUT_PTR(RIGHT_PTR(y), x);
+    PUT_PTR(PARENT_PTR(x), y);
+}
+
 
 static void printblock(void *bp)
 {
@@ -600,37 +2004,181 @@ static void printblock(void *bp)
 
     hsize = GET_SIZE(HDRP(bp));
     halloc = GET_ALLOC(HDRP(bp));
-    fsize = GET_SIZE(FTRP(bp));
-    falloc = GET_ALLOC(FTRP(bp));
 
     if (hsize == 0) {
 	printf("%p: EOL\n", bp);
 	return;
     }
+    if (halloc) {                 /* allocated blocks have no footer */
+	printf("%p: header: [%d:%c]\n", bp, (int)hsize, 'a');
+	return;
+    }
+
+    fsize = GET_SIZE(FTRP(bp));
+    falloc = GET_ALLOC(FTRP(bp));
 
     printf("%p: header: [%d:%c] footer: [%d:%c]\n", bp,
-	   hsize, (halloc ? 'a' : 'f'),
-	   fsize, (falloc ? 'a' : 'f'));
+	   (int)hsize, (halloc ? 'a' : 'f'),
+	   (int)fsize, (falloc ? 'a' : 'f'));
 }
 
-/* Traverse through free list and print each node's previous and next pointers */
-void print_free_list(void* root){
-  void* bp = root;
-  printf("free_list_size = %d \n", free_list_size);
-  for (int i = 0; i < free_list_size; i++){
-    printf("bp = %p \n", bp);
-    printf("bp->next = %p \n", GET(bp));
-    printf("bp->prev = %p \n", GET(bp));
+/* Traverse every nonempty class list and tree and print each node's links */
+void print_free_list(void)
+{
+  int i, fl, sl;
+  char *bp;
 
-    bp = GET(NEXT_PTR(bp));
+  for (i = 0; i < NARENAS; i++){
+  if (arenas[i].tree_root != NULL){
+    printf("arena %d large block tree:\n", i);
+    print_tree(arenas[i].tree_root);
+  }
+  for (fl = 0; fl < FL_COUNT; fl++){
+    for (sl = 0; sl < SL_COUNT; sl++){
+      if (arenas[i].free_lists[fl][sl] == NULL)
+        continue;
+      printf("arena %d class (%d,%d):\n", i, fl, sl);
+      for (bp = arenas[i].free_lists[fl][sl]; bp != NULL; bp = GET_PTR(NEXT_PTR(bp))){
+        printf("bp = %p \n", bp);
+        printf("bp->next = %p \n", GET_PTR(NEXT_PTR(bp)));
+        printf("bp->prev = %p \n", GET_PTR(PREV_PTR(bp)));
+      }
     }
+  }
+  }
+}
+
+/* In-order walk of the tree below bp, printing each node's links */
+static void print_tree(char *bp)
+{
+  if (bp == NULL)
+    return;
+  print_tree(LEFT(bp));
+  printf("bp = %p [%d:%s]\n", bp, (int)GET_SIZE(HDRP(bp)), IS_RED(bp) ? "red" : "black");
+  printf("bp->left = %p \n", LEFT(bp));
+  printf("bp->right = %p \n", RIGHT(bp));
+  printf("bp->parent = %p \n", PARENT(bp));
+  print_tree(RIGHT(bp));
 }
 
+/*
+ * checktree - Check the tree below bp in order, counting its nodes into
+ *     count, and return its black height (-1 after an error)
+ */
+static int checktree(arena_t *a, char *bp, char *parent, char **prev, int *count)
+{
+  int lh, rh;
+
+  if (bp == NULL)
+    return 1;
+  if (!checkmark(a, bp))
+    return -1;     //don't follow a bad link or a cycle
+
+  lh = checktree(a, LEFT(bp), bp, prev, count);
+  (*count)++;
+  if (PARENT(bp) != parent){
+    CHECK_ERROR("ERROR: Broken parent link at %p\n", bp);
+  }
+  if (GET_ALLOC(HDRP(bp)) || GET_SIZE(HDRP(bp)) < LARGE_BLOCK){
+    CHECK_ERROR("ERROR: Block %p does not belong in the large block tree\n", bp);
+  }
+  if (*prev != NULL && !TREE_LESS(*prev, bp)){
+    CHECK_ERROR("ERROR: Large block tree out of order at %p\n", bp);
+  }
+  if (IS_RED(bp) && (IS_RED(LEFT(bp)) || IS_RED(RIGHT(bp)))){
+    CHECK_ERROR("ERROR: Red node %p has a red child\n", bp);
+  }
+  *prev = bp;
+  rh = checktree(a, RIGHT(bp), bp, prev, count);
+
+  if (lh < 0 || rh < 0)
+    return -1;
+  if (lh != rh){
+    CHECK_ERROR("ERROR: Unequal black heights below %p\n", bp);
+    return -1;
+  }
+  return lh + !IS_RED(bp);
+}
+
+/*
+ * checkmark - Set CHECK_MARK on free block bp, found on a list or tree
+ *     of arena a. Return 0 if bp cannot be a free block of a, or was
+ *     already marked, so the caller should stop following that link.
+ */
+static int checkmark(arena_t *a, char *bp)
+{
+  if (bp < (char *)mem_heap_lo() + 2*DSIZE || bp > (char *)mem_heap_hi() || (size_t)bp % ALIGNMENT){
+    CHECK_ERROR("ERROR: Free structure of arena %d links to %p, outside the heap\n", (int)(a - arenas), bp);
+    return 0;
+  }
+  if ((page_arena[PAGE_INDEX(bp)] & ARENA_MASK) != a - arenas){
+    CHECK_ERROR("ERROR: Free block %p is listed in arena %d but lies in another\n", bp, (int)(a - arenas));
+    return 0;
+  }
+  if (GET_ALLOC(HDRP(bp))){
+    CHECK_ERROR("ERROR: Allocated header block in free list\n");   //if header of pointer is allocated
+    return 0;
+  }
+  if (GET(HDRP(bp)) & CHECK_MARK){
+    CHECK_ERROR("ERROR: Free block %p is listed twice\n", bp);
+    return 0;
+  }
+  PUT(HDRP(bp), GET(HDRP(bp)) | CHECK_MARK);
+  return 1;
+}
 
 static void checkblock(void *bp)
 {
-    if ((size_t)bp % 8)
-	printf("Error: %p is not doubleword aligned\n", bp);
-    if (GET(HDRP(bp)) != GET(FTRP(bp)))
-	printf("Error: header does not match footer\n");
+    if ((size_t)bp % ALIGNMENT)
+	CHECK_ERROR("Error: %p is not doubleword aligned\n", bp);
+    if (GET_SIZE(HDRP(bp)) % DSIZE || GET_SIZE(HDRP(bp)) < MIN_BLOCK)
+	CHECK_ERROR("Error: %p has size %u, not a whole number of blocks\n",
+		    bp, (unsigned)GET_SIZE(HDRP(bp)));
+    if ((page_arena[PAGE_INDEX(bp)] & SLAB_PAGE) && (size_t)bp % PAGESIZE)
+	CHECK_ERROR("Error: slab %p does not start on a page\n", bp);
+    if ((page_arena[PAGE_INDEX(bp)] & NURSERY_PAGE) && (size_t)bp % NURSERY_SIZE)
+	CHECK_ERROR("Error: block %p lies in a nursery\n", bp);
+    if (!GET_ALLOC(HDRP(bp)) && GET_SIZE(HDRP(bp)) != GET(FTRP(bp)))
+	CHECK_ERROR("Error: header does not match footer\n");
+}
+
+/*
+ * checknursery - Check that nursery n's objects tile it up to its bump
+ *     pointer and that as many are allocated as it counts live. Only
+ *     arena a's current and spare nurseries may have none.
+ */
+static void checknursery(arena_t *a, nursery_t *n)
+{
+    char *p;
+    size_t live = 0;
+
+    if (GET_SIZE(HDRP(n)) != NURSERY_SIZE)
+	CHECK_ERROR("Error: nursery %p is not %d bytes\n", n, NURSERY_SIZE);
+    for (p = (char *)n + NURSERY_FIRST; p < n->bump; p += GET_SIZE(HDRP(p))) {
+	if (GET_SIZE(HDRP(p)) == 0 || GET_SIZE(HDRP(p)) % DSIZE) {
+	    CHECK_ERROR("Error: nursery %p has a bad object at %p\n", n, p);
+	    return;
+	}
+	live += GET_ALLOC(HDRP(p));
+    }
+    if (p != n->bump || p > (char *)n + NURSERY_SIZE)
+	CHECK_ERROR("Error: nursery %p overruns its bump pointer\n", n);
+    if (live != n->live || (live == 0 && n != a->nursery && n != a->spare))
+	CHECK_ERROR("Error: nursery %p counts %lu live objects, has %lu\n",
+		    n, (unsigned long)n->live, (unsigned long)live);
+}
+
+static void checkslab(slab_t *s)
+{
+    int i, nfree = 0;
+
+    if ((char *)s != (char *)SLAB_OF(s) || GET_SIZE(HDRP(s)) != PAGESIZE)
+	CHECK_ERROR("Error: slab %p is not a whole page\n", s);
+    if (s->cls >= SLAB_CLASSES)
+	CHECK_ERROR("Error: slab %p has bad class %d\n", s, s->cls);
+    for (i = 0; i < SLAB_WORDS; i++)
+	nfree += __builtin_popcount(s->map[i]);
+    if (nfree != s->nfree || nfree > SLAB_CAP(s->cls))
+	CHECK_ERROR("Error: slab %p counts %d free objects, bitmap has %d\n",
+	       s, s->nfree, nfree);
 }
@@ -2,8 +2,23 @@
 
 extern int mm_init (void);
 extern void *mm_malloc (size_t size);
+extern void *mm_malloc_hint(size_t size, int lifetime);
 extern void mm_free (void *ptr);
 extern void *mm_realloc(void *ptr, size_t size);
+extern void *mm_memalign(size_t alignment, size_t size);
+extern void *mm_calloc(size_t nmemb, size_t size);
+extern size_t mm_malloc_batch(size_t size, size_t n, void **out);
+extern void mm_free_batch(void **ptrs, size_t n);
+extern size_t mm_usable_size(void *ptr);
+extern void mm_freestats(size_t *count, size_t *largest);
+extern void mm_growstats(size_t *exact, size_t *doubled, size_t *halved);
+extern int mm_checkheap(int verbose);
+extern void mm_lock_all(void);
+extern void mm_unlock_all(void);
+
+/* Lifetime classes for mm_malloc_hint */
+#define MM_LONG_LIVED   0
+#define MM_SHORT_LIVED  1
 
 
 /* 
@@ -0,0 +1,174 @@
+/*
+ * mmshim.c - export the mm package as the process allocator, so it can
+ *            be measured under real programs instead of traces
+ *
+ * usage: LD_PRELOAD=./mmshim.so <program> [args...]
+ *
+ * The heap is memlib's: MAX_HEAP bytes of address space reserved with
+ * mmap on the first request, committed page by page as the brk grows.
+ * The shim is built with a MAX_HEAP large enough for a real process
+ * (see the Makefile). Requests go straight to mm.c, whose per-thread
+ * arenas keep the common path to one uncontended lock; after the first
+ * call, initialization costs one pthread_once check.
+ *
+ * A multithreaded program may fork while another thread holds one of
+ * the allocator's locks, and the child would then wait on it forever.
+ * So fork handlers, registered when the shim is loaded, take every
+ * lock before the fork and release them in both processes after it.
+ */
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "config.h"
+
+static pthread_once_t shim_once = PTHREAD_ONCE_INIT;
+
+static void shim_init(void);
+static void shim_atfork(void) __attribute__((constructor));
+static void shim_prefork(void);
+static void *shim_memalign(size_t alignment, size_t size);
+
+/*
+ * shim_init - Reserve the heap and initialize the mm package, once
+ */
+static void shim_init(void)
+{
+    mem_init();
+    if (mm_init() < 0)
+	abort();
+}
+
+/*
+ * shim_atfork - Register the fork handlers when the shim is loaded,
+ *     since pthread_atfork may itself call malloc
+ */
+static void shim_atfork(void)
+{
+    pthread_atfork(shim_prefork, mm_unlock_all, mm_unlock_all);
+}
+
+/*
+ * shim_prefork - Hold every allocator lock across a fork. The package
+ *     is initialized first, so that there are locks to take.
+ */
+static void shim_prefork(void)
+{
+    pthread_once(&shim_once, shim_init);
+    mm_lock_all();
+}
+
+void *malloc(size_t size)
+{
+    void *p;
+
+    pthread_once(&shim_once, shim_init);
+    if (size > MAX_HEAP || (p = mm_malloc(size ? size : 1)) == NULL) {
+	errno = ENOMEM;
+	return NULL;
+    }
+    return p;
+}
+
+/* a non-NULL ptr came from malloc, so the package is initialized */
+void free(void *ptr)
+{
+    if (ptr != NULL)
+	mm_free(ptr);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    void *p;
+
+    pthread_once(&shim_once, shim_init);
+    if (nmemb == 0 || size == 0)
+	nmemb = size = 1;
+    if (nmemb > MAX_HEAP / size || (p = mm_calloc(nmemb, size)) == NULL) {
+	errno = ENOMEM;
+	return NULL;
+    }
+    return p;
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    void *p;
+
+    if (ptr == NULL)
+	return malloc(size);
+    if (size == 0) {
+	mm_free(ptr);
+	return NULL;
+    }
+    if (size > MAX_HEAP || (p = mm_realloc(ptr, size)) == NULL) {
+	errno = ENOMEM;
+	return NULL;
+    }
+    return p;
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+    void *p;
+
+    if (alignment % sizeof(void *) != 0 || (alignment & (alignment-1)))
+	return EINVAL;
+    if ((p = shim_memalign(alignment, size)) == NULL)
+	return ENOMEM;
+    *memptr = p;
+    return 0;
+}
+
+/*
+ * The other aligned entry points must be ours as well, or libc would
+ * hand out blocks that our free cannot take back.
+ */
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    if (alignment == 0 || (alignment & (alignment-1))) {
+	errno = EINVAL;
+	return NULL;
+    }
+    return shim_memalign(alignment, size);
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+    return aligned_alloc(alignment, size);
+}
+
+void *valloc(size_t size)
+{
+    return shim_memalign(mem_pagesize(), size);
+}
+
+void *pvalloc(size_t size)
+{
+    size_t page = mem_pagesize();
+
+    return shim_memalign(page, (size + page-1) & ~(page-1));
+}
+
+size_t malloc_usable_size(void *ptr)
+{
+    return ptr != NULL ? mm_usable_size(ptr) : 0;
+}
+
+/*
+ * shim_memalign - mm_memalign, setting errno the way libc does
+ */
+static void *shim_memalign(size_t alignment, size_t size)
+{
+    void *p;
+
+    pthread_once(&shim_once, shim_init);
+    if (size > MAX_HEAP || alignment > MAX_HEAP ||
+	(p = mm_memalign(alignment, size ? size : 1)) == NULL) {
+	errno = ENOMEM;
+	return NULL;
+    }
+    return p;
+}
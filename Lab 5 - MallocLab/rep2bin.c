@@ -0,0 +1,100 @@
+/*
+ * rep2bin.c - convert a .rep trace file to the binary format that
+ *             mdriver maps directly (see tracefmt.h)
+ *
+ * usage: rep2bin <in.rep> <out.bin>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tracefmt.h"
+
+int main(int argc, char **argv)
+{
+    FILE *in, *out;
+    tracehdr_t hdr;
+    traceop_t op;
+    char type[1024];
+    int max_index = -1, last;
+    int n = 0;
+
+    if (argc != 3) {
+	fprintf(stderr, "usage: %s <in.rep> <out.bin>\n", argv[0]);
+	exit(1);
+    }
+    if ((in = fopen(argv[1], "r")) == NULL) {
+	perror(argv[1]);
+	exit(1);
+    }
+    if ((out = fopen(argv[2], "w")) == NULL) {
+	perror(argv[2]);
+	exit(1);
+    }
+
+    /* The .rep header: heap size, ids, ops and weight */
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic));
+    hdr.version = TRACE_VERSION;
+    if (fscanf(in, "%d %d %d %d", &hdr.sugg_heapsize, &hdr.num_ids,
+	       &hdr.num_ops, &hdr.weight) != 4) {
+	fprintf(stderr, "%s: bad trace header\n", argv[1]);
+	exit(1);
+    }
+    fwrite(&hdr, sizeof(hdr), 1, out);
+
+    /* One packed record per request line */
+    while (fscanf(in, "%s", type) != EOF) {
+	memset(&op, 0, sizeof(op));
+	switch (type[0]) {
+	case 'a':
+	    op.type = ALLOC;
+	    fscanf(in, "%d %d", &op.index, &op.size);
+	    break;
+	case 'r':
+	    op.type = REALLOC;
+	    fscanf(in, "%d %d", &op.index, &op.size);
+	    break;
+	case 'f':
+	    op.type = FREE;
+	    fscanf(in, "%d", &op.index);
+	    break;
+	case 'A':
+	    op.type = ALLOC_BATCH;
+	    fscanf(in, "%d %d %d", &op.index, &op.count, &op.size);
+	    break;
+	case 'F':
+	    op.type = FREE_BATCH;
+	    fscanf(in, "%d %d", &op.index, &op.count);
+	    break;
+	case 'm':
+	    op.type = MEMALIGN;
+	    fscanf(in, "%d %d %d", &op.index, &op.count, &op.size);
+	    break;
+	case 'c':
+	    op.type = CALLOC;
+	    fscanf(in, "%d %d %d", &op.index, &op.count, &op.size);
+	    break;
+	default:
+	    fprintf(stderr, "%s: bogus type character (%c)\n", argv[1], type[0]);
+	    exit(1);
+	}
+	last = op.type == ALLOC_BATCH ? op.index + op.count - 1 : op.index;
+	if (last > max_index)
+	    max_index = last;
+	fwrite(&op, sizeof(op), 1, out);
+	n++;
+    }
+
+    if (n != hdr.num_ops || max_index != hdr.num_ids - 1) {
+	fprintf(stderr, "%s: header says %d ids and %d ops, found %d and %d\n",
+		argv[1], hdr.num_ids, hdr.num_ops, max_index + 1, n);
+	exit(1);
+    }
+    if (fclose(out) != 0) {
+	perror(argv[2]);
+	exit(1);
+    }
+    fclose(in);
+    exit(0);
+}
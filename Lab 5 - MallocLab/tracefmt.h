@@ -0,0 +1,38 @@
+/*
+ * tracefmt.h - binary trace format, read by mdriver and written by
+ *              rep2bin
+ *
+ * A binary trace is a tracehdr_t followed by num_ops traceop_t records,
+ * in host byte order. mdriver maps the file and replays the records in
+ * place, so the record layout is exactly mdriver's in-memory one.
+ *
+ * Besides "a id size", "r id size" and "f id", a .rep trace may hold
+ * batch requests: "A id n size" allocates ids id..id+n-1 with one
+ * mm_malloc_batch call, and "F id n" frees them with one mm_free_batch.
+ * "m id align size" allocates id with mm_memalign, and "c id n size"
+ * allocates an array of n elements of size bytes for id with mm_calloc.
+ */
+#define TRACE_MAGIC    "MMTRACE"   /* 8 bytes with the terminating 0 */
+#define TRACE_VERSION  2
+
+/* Request types */
+enum {ALLOC, FREE, REALLOC, ALLOC_BATCH, FREE_BATCH, MEMALIGN, CALLOC};
+
+/* Characterizes a single trace operation (allocator request) */
+typedef struct {
+    int type;                         /* type of request */
+    int index;                        /* index for free() to use later */
+    int size;                         /* byte size of alloc/realloc request */
+    int count;                        /* batch ids, alignment, or elements */
+} traceop_t;
+
+/* Fixed header of a binary trace file */
+typedef struct {
+    char magic[8];       /* TRACE_MAGIC */
+    int version;         /* TRACE_VERSION */
+    int sugg_heapsize;   /* suggested heap size (unused) */
+    int num_ids;         /* number of alloc/realloc ids */
+    int num_ops;         /* number of distinct requests */
+    int weight;          /* weight for this trace (unused) */
+    int pad;             /* keeps the records 8-byte aligned */
+} tracehdr_t;
@@ -0,0 +1,477 @@
+/*
+ * tracegen.c - generate synthetic .rep traces from parameterized
+ *              allocation workload models
+ *
+ * The generator runs a discrete clock with one tick per allocation.
+ * Every allocation draws a payload size and a lifetime (in ticks) from
+ * the current phase's distributions, and schedules its free for when
+ * the lifetime runs out. A growth chain block also schedules reallocs
+ * that multiply its size by the growth factor until it dies. When a
+ * target live set is given, allocation pauses while the live payload
+ * bytes are at or above it and the clock skips ahead to the next
+ * scheduled free or realloc instead. Everything still live at the end
+ * is freed, so the traces are balanced like the default ones.
+ *
+ * With -B P:N, an allocation is instead, with probability P, a batch
+ * of N blocks of the drawn size and lifetime, made by one "A" request
+ * and freed by one "F" request (see tracefmt.h). With -A P:ALIGN, an
+ * allocation is with probability P an "m" request for an ALIGN-byte
+ * aligned block, and with -C P a "c" request for a zero-filled one.
+ *
+ * Giving -d or -l several times splits the run into phases: phase i
+ * uses the i-th size and lifetime model (or the last one given), and
+ * the allocations are divided evenly among the phases.
+ *
+ * Distribution specs (sizes in bytes, lifetimes in ticks):
+ *   N                 the constant N
+ *   uni:MIN:MAX       uniform on [MIN, MAX]
+ *   exp:MEAN          exponential with mean MEAN
+ *   pow:MIN:MAX:A     power law (Pareto, exponent A) truncated to [MIN, MAX]
+ *   bi:X:Y:P          X with probability P, else Y
+ *   hist:FILE         empirical histogram, one "value weight" pair per line
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+
+#include "tracefmt.h"
+
+#define MAXPHASES  16        /* most -d or -l models */
+#define MAXSIZE    (1<<24)   /* largest payload a realloc chain grows to */
+
+/* A distribution parsed from a spec */
+typedef struct {
+    enum {CONST, UNIFORM, EXPON, POWER, BIMODAL, HIST} kind;
+    double a, b, c;          /* parameters, in spec order */
+    int n;                   /* number of histogram bins */
+    double *val, *cum;       /* bin values and cumulative weights */
+} dist_t;
+
+/* A scheduled free or realloc of block id at tick time */
+typedef struct {
+    long time;
+    int id;
+    int type;                /* FREE, REALLOC or FREE_BATCH */
+} event_t;
+
+/* Global variables */
+static dist_t sizes[MAXPHASES], lives[MAXPHASES];
+static int nsizes, nlives;
+
+static event_t *events;      /* min-heap on time */
+static int nevents, maxevents;
+
+static traceop_t *ops;       /* the generated trace */
+static int nops, maxops;
+
+/* A generated block */
+typedef struct {
+    int size;                /* current payload, 0 once freed */
+    long life;               /* lifetime it was drawn with */
+} block_t;
+
+static block_t *blocks;      /* indexed by id */
+static int nids, maxids;
+
+/* Function prototypes */
+static void parse_dist(dist_t *d, char *spec);
+static double draw(dist_t *d);
+static void schedule(long time, int id, int type);
+static event_t next_event(void);
+static void emit(int type, int index, int size, int count);
+static void write_rep(FILE *out, int heapsize);
+static void write_bin(FILE *out, int heapsize);
+static void *grow(void *p, int n, int *max, size_t elsize);
+static void usage(char *prog);
+
+int main(int argc, char **argv)
+{
+    long n = 10000;          /* allocations to generate (-n) */
+    double target = 0;       /* live payload bytes to hold at (-L), 0 = none */
+    double chain = 0;        /* chance an allocation is a growth chain (-r) */
+    double factor = 1.5;     /* growth per realloc in a chain (-g) */
+    double batch = 0;        /* chance an allocation is a batch (-B) */
+    int batchn = 0;          /* blocks in such a batch */
+    double aligned = 0;      /* chance an allocation is aligned (-A) */
+    int align = 0;           /* alignment of such an allocation */
+    double zeroed = 0;       /* chance an allocation is a calloc (-C) */
+    int binary = 0;          /* write a binary trace (-b) */
+    char *outfile = NULL;    /* -o, else stdout */
+    FILE *out = stdout;
+    long now, allocs = 0;
+    double live = 0, peak = 0;
+    int c, i, id, phase, size;
+    long life;
+    event_t e;
+
+    srand48(1);
+    while ((c = getopt(argc, argv, "n:s:L:d:l:r:g:B:A:C:bo:h")) != EOF) {
+	switch (c) {
+	case 'n': n = atol(optarg); break;
+	case 's': srand48(atol(optarg)); break;
+	case 'L': target = atof(optarg); break;
+	case 'd':
+	    if (nsizes == MAXPHASES)
+		usage(argv[0]);
+	    parse_dist(&sizes[nsizes++], optarg);
+	    break;
+	case 'l':
+	    if (nlives == MAXPHASES)
+		usage(argv[0]);
+	    parse_dist(&lives[nlives++], optarg);
+	    break;
+	case 'r': chain = atof(optarg); break;
+	case 'C': zeroed = atof(optarg); break;
+	case 'g': factor = atof(optarg); break;
+	case 'B':
+	    if (sscanf(optarg, "%lf:%d", &batch, &batchn) != 2 || batchn < 1)
+		usage(argv[0]);
+	    break;
+	case 'A':
+	    if (sscanf(optarg, "%lf:%d", &aligned, &align) != 2 ||
+		align < 1 || (align & (align-1)))
+		usage(argv[0]);
+	    break;
+	case 'b': binary = 1; break;
+	case 'o': outfile = optarg; break;
+	default: usage(argv[0]);
+	}
+    }
+    if (nsizes == 0)
+	parse_dist(&sizes[nsizes++], "pow:8:4096:1.2");
+    if (nlives == 0)
+	parse_dist(&lives[nlives++], "exp:1000");
+    if (n <= 0 || factor <= 1)
+	usage(argv[0]);
+
+    /* Run the clock until every allocation is made */
+    now = 0;
+    while (allocs < n) {
+	if (nevents > 0 && events[0].time <= now) {
+	    e = next_event();
+	    if (blocks[e.id].size == 0)
+		continue;          /* a stale event for a freed block */
+	    if (e.type == FREE) {
+		emit(FREE, e.id, 0, 0);
+		live -= blocks[e.id].size;
+		blocks[e.id].size = 0;
+	    }
+	    else if (e.type == FREE_BATCH) {
+		emit(FREE_BATCH, e.id, 0, batchn);
+		live -= (double)blocks[e.id].size * batchn;
+		for (i = 0; i < batchn; i++)
+		    blocks[e.id + i].size = 0;
+	    }
+	    else {
+		size = (int)(blocks[e.id].size * factor);
+		size = size > MAXSIZE ? MAXSIZE : size;
+		emit(REALLOC, e.id, size, 0);
+		live += size - blocks[e.id].size;
+		blocks[e.id].size = size;
+		schedule(now + 1 + (long)(drand48() * blocks[e.id].life / 2), e.id, REALLOC);
+	    }
+	}
+	else if (target == 0 || live < target || nevents == 0) {
+	    phase = allocs * (nsizes > nlives ? nsizes : nlives) / n;
+	    size = (int)draw(&sizes[phase < nsizes ? phase : nsizes-1]);
+	    size = size < 1 ? 1 : size > MAXSIZE ? MAXSIZE : size;
+	    life = (long)draw(&lives[phase < nlives ? phase : nlives-1]);
+	    life = life < 1 ? 1 : life;
+
+	    /* a batch is allocated and freed together, and never grows */
+	    if (batch > 0 && drand48() < batch) {
+		id = nids;
+		for (i = 0; i < batchn; i++) {
+		    blocks = grow(blocks, nids, &maxids, sizeof(block_t));
+		    blocks[nids].size = size;
+		    blocks[nids++].life = life;
+		}
+		emit(ALLOC_BATCH, id, size, batchn);
+		live += (double)size * batchn;
+		schedule(now + life, id, FREE_BATCH);
+		allocs += batchn;
+		now++;
+		peak = live > peak ? live : peak;
+		continue;
+	    }
+
+	    id = nids++;
+	    blocks = grow(blocks, id, &maxids, sizeof(block_t));
+	    blocks[id].size = size;
+	    blocks[id].life = life;
+	    if (aligned > 0 && drand48() < aligned)
+		emit(MEMALIGN, id, size, align);
+	    else if (zeroed > 0 && drand48() < zeroed)
+		emit(CALLOC, id, size, 1);
+	    else
+		emit(ALLOC, id, size, 0);
+	    live += size;
+	    schedule(now + life, id, FREE);
+
+	    /* a growth chain reallocs about four times over its life */
+	    if (drand48() < chain)
+		schedule(now + 1 + (long)(drand48() * life / 2), id, REALLOC);
+	    allocs++;
+	    now++;
+	}
+	else
+	    now = events[0].time;  /* live set is full: wait for a free */
+	peak = live > peak ? live : peak;
+    }
+
+    /* Free what is still live, in the order it would have died */
+    while (nevents > 0) {
+	e = next_event();
+	if (e.type == REALLOC || blocks[e.id].size == 0)
+	    continue;
+	emit(e.type, e.id, 0, e.type == FREE_BATCH ? batchn : 0);
+	for (i = 0; i < (e.type == FREE_BATCH ? batchn : 1); i++)
+	    blocks[e.id + i].size = 0;
+    }
+
+    if (outfile != NULL && (out = fopen(outfile, "w")) == NULL) {
+	perror(outfile);
+	exit(1);
+    }
+    if (binary)
+	write_bin(out, (int)peak);
+    else
+	write_rep(out, (int)peak);
+    if (fclose(out) != 0) {
+	perror(outfile ? outfile : "stdout");
+	exit(1);
+    }
+    exit(0);
+}
+
+/*
+ * parse_dist - Fill in d from a spec string, exiting on a bad spec
+ */
+static void parse_dist(dist_t *d, char *spec)
+{
+    FILE *f;
+    double v, w;
+    int maxbins = 0;
+
+    memset(d, 0, sizeof(dist_t));
+    if (sscanf(spec, "uni:%lf:%lf", &d->a, &d->b) == 2)
+	d->kind = UNIFORM;
+    else if (sscanf(spec, "exp:%lf", &d->a) == 1)
+	d->kind = EXPON;
+    else if (sscanf(spec, "pow:%lf:%lf:%lf", &d->a, &d->b, &d->c) == 3 &&
+	     d->a > 0 && d->b > d->a && d->c > 0)
+	d->kind = POWER;
+    else if (sscanf(spec, "bi:%lf:%lf:%lf", &d->a, &d->b, &d->c) == 3)
+	d->kind = BIMODAL;
+    else if (strncmp(spec, "hist:", 5) == 0) {
+	d->kind = HIST;
+	if ((f = fopen(spec + 5, "r")) == NULL) {
+	    perror(spec + 5);
+	    exit(1);
+	}
+	while (fscanf(f, "%lf %lf", &v, &w) == 2) {
+	    if (d->n == maxbins) {
+		maxbins = maxbins ? 2*maxbins : 64;
+		d->val = realloc(d->val, maxbins * sizeof(double));
+		d->cum = realloc(d->cum, maxbins * sizeof(double));
+		if (d->val == NULL || d->cum == NULL) {
+		    fprintf(stderr, "realloc failed in parse_dist\n");
+		    exit(1);
+		}
+	    }
+	    d->val[d->n] = v;
+	    d->cum[d->n] = (d->n ? d->cum[d->n-1] : 0) + w;
+	    d->n++;
+	}
+	fclose(f);
+	if (d->n == 0 || d->cum[d->n-1] <= 0) {
+	    fprintf(stderr, "%s: empty histogram\n", spec + 5);
+	    exit(1);
+	}
+    }
+    else if (sscanf(spec, "%lf", &d->a) == 1)
+	d->kind = CONST;
+    else {
+	fprintf(stderr, "Bad distribution spec: %s\n", spec);
+	exit(1);
+    }
+}
+
+/*
+ * draw - Return a random value from distribution d
+ */
+static double draw(dist_t *d)
+{
+    double u = drand48();
+    double lo, hi;
+    int l, h, m;
+
+    switch (d->kind) {
+    case UNIFORM:
+	return d->a + u * (d->b - d->a + 1);
+    case EXPON:
+	return -d->a * log(1 - u);
+    case POWER:  /* inverse CDF of a Pareto truncated to [a, b] */
+	lo = pow(d->a, -d->c);
+	hi = pow(d->b, -d->c);
+	return pow(lo - u * (lo - hi), -1 / d->c);
+    case BIMODAL:
+	return u < d->c ? d->a : d->b;
+    case HIST:   /* first bin whose cumulative weight exceeds u */
+	u *= d->cum[d->n-1];
+	for (l = 0, h = d->n-1; l < h; ) {
+	    m = (l + h) / 2;
+	    if (d->cum[m] > u)
+		h = m;
+	    else
+		l = m + 1;
+	}
+	return d->val[l];
+    default:
+	return d->a;
+    }
+}
+
+/*
+ * schedule - Add an event for block id at the given time
+ */
+static void schedule(long time, int id, int type)
+{
+    int i, p;
+
+    events = grow(events, nevents, &maxevents, sizeof(event_t));
+    for (i = nevents++; i > 0; i = p) {    /* sift up */
+	p = (i - 1) / 2;
+	if (events[p].time <= time)
+	    break;
+	events[i] = events[p];
+    }
+    events[i].time = time;
+    events[i].id = id;
+    events[i].type = type;
+}
+
+/*
+ * next_event - Remove and return the earliest event
+ */
+static event_t next_event(void)
+{
+    event_t top = events[0];
+    event_t last = events[--nevents];
+    int i, c;
+
+    for (i = 0; (c = 2*i + 1) < nevents; i = c) {  /* sift down */
+	if (c + 1 < nevents && events[c+1].time < events[c].time)
+	    c++;
+	if (last.time <= events[c].time)
+	    break;
+	events[i] = events[c];
+    }
+    events[i] = last;
+    return top;
+}
+
+/*
+ * emit - Append a request to the trace
+ */
+static void emit(int type, int index, int size, int count)
+{
+    ops = grow(ops, nops, &maxops, sizeof(traceop_t));
+    ops[nops].type = type;
+    ops[nops].index = index;
+    ops[nops].size = size;
+    ops[nops].count = count;
+    nops++;
+}
+
+/*
+ * write_rep - Write the trace in .rep text form
+ */
+static void write_rep(FILE *out, int heapsize)
+{
+    int i;
+
+    fprintf(out, "%d\n%d\n%d\n%d\n", heapsize, nids, nops, 1);
+    for (i = 0; i < nops; i++) {
+	switch (ops[i].type) {
+	case ALLOC:
+	    fprintf(out, "a %d %d\n", ops[i].index, ops[i].size);
+	    break;
+	case REALLOC:
+	    fprintf(out, "r %d %d\n", ops[i].index, ops[i].size);
+	    break;
+	case ALLOC_BATCH:
+	    fprintf(out, "A %d %d %d\n", ops[i].index, ops[i].count, ops[i].size);
+	    break;
+	case FREE_BATCH:
+	    fprintf(out, "F %d %d\n", ops[i].index, ops[i].count);
+	    break;
+	case MEMALIGN:
+	    fprintf(out, "m %d %d %d\n", ops[i].index, ops[i].count, ops[i].size);
+	    break;
+	case CALLOC:
+	    fprintf(out, "c %d %d %d\n", ops[i].index, ops[i].count, ops[i].size);
+	    break;
+	default:
+	    fprintf(out, "f %d\n", ops[i].index);
+	}
+    }
+}
+
+/*
+ * write_bin - Write the trace in the binary form of tracefmt.h
+ */
+static void write_bin(FILE *out, int heapsize)
+{
+    tracehdr_t hdr;
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic));
+    hdr.version = TRACE_VERSION;
+    hdr.sugg_heapsize = heapsize;
+    hdr.num_ids = nids;
+    hdr.num_ops = nops;
+    hdr.weight = 1;
+    fwrite(&hdr, sizeof(hdr), 1, out);
+    fwrite(ops, sizeof(traceop_t), nops, out);
+}
+
+/*
+ * grow - Make room for element n of array p, which holds *max
+ *     elements, doubling it when full
+ */
+static void *grow(void *p, int n, int *max, size_t elsize)
+{
+    if (n < *max)
+	return p;
+    *max = *max ? 2 * *max : 1024;
+    if ((p = realloc(p, *max * elsize)) == NULL) {
+	fprintf(stderr, "realloc failed in grow\n");
+	exit(1);
+    }
+    return p;
+}
+
+static void usage(char *prog)
+{
+    fprintf(stderr, "Usage: %s [-b] [-n <allocs>] [-s <seed>] [-L <bytes>] "
+	    "[-d <dist>]... [-l <dist>]... [-r <p>] [-g <factor>] [-B <p>:<n>] [-A <p>:<align>] [-C <p>] [-o <file>]\n", prog);
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-A <p>:<a> Chance that an allocation is <a>-byte aligned.\n");
+    fprintf(stderr, "\t-b         Write a binary trace instead of .rep text.\n");
+    fprintf(stderr, "\t-C <p>     Chance that an allocation is a calloc.\n");
+    fprintf(stderr, "\t-B <p>:<n> Chance that an allocation is a batch of <n> blocks.\n");
+    fprintf(stderr, "\t-d <dist>  Payload size model; repeat for more phases.\n");
+    fprintf(stderr, "\t-g <f>     Size factor per realloc in a growth chain (1.5).\n");
+    fprintf(stderr, "\t-l <dist>  Lifetime model, in allocations; repeat for more phases.\n");
+    fprintf(stderr, "\t-L <bytes> Hold the live payload at about this many bytes.\n");
+    fprintf(stderr, "\t-n <n>     Number of allocations (10000).\n");
+    fprintf(stderr, "\t-o <file>  Write to <file> instead of stdout.\n");
+    fprintf(stderr, "\t-r <p>     Chance that an allocation starts a growth chain.\n");
+    fprintf(stderr, "\t-s <seed>  Random seed.\n");
+    fprintf(stderr, "Distributions: N, uni:MIN:MAX, exp:MEAN, pow:MIN:MAX:A, "
+	    "bi:X:Y:P, hist:FILE\n");
+    exit(1);
+}